@@ -0,0 +1,50 @@
+#include <filesystem>
+#include <sstream>
+
+#include "libnpy_bench.h"
+
+namespace {
+const std::string DICTIONARY =
+    "{'descr': '<f4', 'fortran_order': False, 'shape': (64, 3, 224, 224), }";
+const std::string TEMP_DIR = "bench_header_parse";
+const std::size_t NUM_FILES = 256;
+} // namespace
+
+int bench_header_parse(std::size_t scale) {
+  std::size_t total = 0;
+
+  bench::measure("header_info(dictionary)", 1000000 * scale, [&]() {
+    npy::header_info info(DICTIONARY);
+    total += info.shape.size();
+  });
+
+  // a small NPY file, as a whole, in memory
+  npy::tensor<float> tensor({4, 4});
+  std::ostringstream output;
+  npy::save(output, tensor);
+  const std::string bytes = output.str();
+  bench::measure("peek(istream)", 1000000 * scale, [&]() {
+    std::istringstream input(bytes);
+    total += npy::peek(input).shape.size();
+  });
+
+  // many small files on disk, which is dominated by opening each file
+  std::filesystem::create_directories(TEMP_DIR);
+  std::vector<std::string> paths;
+  for (std::size_t i = 0; i < NUM_FILES; ++i) {
+    paths.push_back(TEMP_DIR + "/" + std::to_string(i) + ".npy");
+    npy::save(paths.back(), tensor);
+  }
+
+  std::size_t next = 0;
+  bench::measure("peek(path)", 100000 * scale, [&]() {
+    total += npy::peek(paths[next]).shape.size();
+    next = (next + 1) % NUM_FILES;
+  });
+
+  std::filesystem::remove_all(TEMP_DIR);
+
+  // printing the total ensures none of the parses can be optimised away
+  std::cout << "(checksum " << total << ")" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,36 @@
+#include <functional>
+#include <map>
+
+#include "libnpy_bench.h"
+
+typedef std::function<int(std::size_t)> BenchFunction;
+
+int main(int argc, char **argv) {
+  std::map<std::string, BenchFunction> benchmarks;
+
+  benchmarks["header_parse"] = bench_header_parse;
+  benchmarks["npz_codecs"] = bench_npz_codecs;
+  benchmarks["npz_lookup"] = bench_npz_lookup;
+
+  // the scale multiplies the number of iterations of every benchmark
+  std::size_t scale = argc == 3 ? std::stoul(argv[2]) : 1;
+  if (argc >= 2) {
+    std::string name(argv[1]);
+    if (benchmarks.count(name)) {
+      return benchmarks[name](scale);
+    } else {
+      std::cout << "Invalid benchmark: " << name << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else {
+    int result = EXIT_SUCCESS;
+    for (auto &benchmark : benchmarks) {
+      std::cout << "Running " << benchmark.first << "..." << std::endl;
+      if (benchmark.second(scale)) {
+        result = EXIT_FAILURE;
+      }
+    }
+
+    return result;
+  }
+}
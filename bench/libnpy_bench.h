@@ -0,0 +1,40 @@
+#ifndef _LIBNPY_BENCH_H_
+#define _LIBNPY_BENCH_H_
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "npy/npy.h"
+
+int bench_header_parse(std::size_t scale);
+int bench_npz_codecs(std::size_t scale);
+int bench_npz_lookup(std::size_t scale);
+
+namespace bench {
+/// Runs a function repeatedly and reports the mean time per iteration.
+/// @param name the name to report
+/// @param iterations the number of times to call the function
+/// @param func the function to time
+/// @return the mean time per iteration in nanoseconds
+template <typename F>
+double measure(const std::string &name, std::size_t iterations, F func) {
+  // one untimed call to warm the caches
+  func();
+
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    func();
+  }
+
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  double mean = elapsed.count() / static_cast<double>(iterations);
+  std::cout << name << ": " << mean << " ns/iter (" << iterations
+            << " iterations)" << std::endl;
+  return mean;
+}
+} // namespace bench
+
+#endif
@@ -0,0 +1,106 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "libnpy_bench.h"
+
+namespace {
+const std::string ASSETS_DIR = "assets/test";
+
+/// A tensor filled in the same way as the tests' test_tensor
+template <typename T> std::string test_array(const std::vector<size_t> &shape) {
+  npy::tensor<T> tensor(shape);
+  T value = 0;
+  for (auto &element : tensor) {
+    element = value;
+    value += 1;
+  }
+
+  std::ostringstream output;
+  npy::save(output, tensor);
+  return output.str();
+}
+
+/// The NPY files the tests use, which are small
+std::vector<std::string> asset_arrays() {
+  std::vector<std::string> arrays;
+  if (!std::filesystem::is_directory(ASSETS_DIR)) {
+    return arrays;
+  }
+
+  for (auto &file : std::filesystem::directory_iterator(ASSETS_DIR)) {
+    if (file.path().extension() == ".npy") {
+      std::ifstream input(file.path(), std::ios::binary);
+      std::ostringstream bytes;
+      bytes << input.rdbuf();
+      arrays.push_back(bytes.str());
+    }
+  }
+
+  return arrays;
+}
+
+void bench_codec(const npy::codec &codec, const std::string &label,
+                 const std::vector<std::string> &arrays, std::size_t iterations,
+                 std::size_t &total) {
+  std::size_t uncompressed_size = 0;
+  std::vector<std::string> compressed;
+  for (auto &array : arrays) {
+    uncompressed_size += array.size();
+    compressed.push_back(codec.compress(array.data(), array.size(), 0));
+  }
+
+  std::size_t compressed_size = 0;
+  for (auto &bytes : compressed) {
+    compressed_size += bytes.size();
+  }
+
+  std::string suffix = "(" + codec.name() + ", " + label + ")";
+  double compress_ns = bench::measure("compress" + suffix, iterations, [&]() {
+    for (auto &array : arrays) {
+      total += codec.compress(array.data(), array.size(), 0).size();
+    }
+  });
+
+  double decompress_ns =
+      bench::measure("decompress" + suffix, iterations, [&]() {
+        for (std::size_t i = 0; i < arrays.size(); ++i) {
+          std::string bytes = compressed[i];
+          total += codec.decompress(std::move(bytes), arrays[i].size()).size();
+        }
+      });
+
+  // bytes per nanosecond is (decimal) GB/s, so scale to MB/s
+  double size = static_cast<double>(uncompressed_size);
+  std::cout << "  ratio " << size / static_cast<double>(compressed_size)
+            << ", compress " << 1000 * size / compress_ns
+            << " MB/s, decompress " << 1000 * size / decompress_ns << " MB/s"
+            << std::endl;
+}
+} // namespace
+
+int bench_npz_codecs(std::size_t scale) {
+  std::size_t total = 0;
+
+  std::vector<std::string> large = {
+      test_array<std::uint8_t>({64, 128, 129}),
+      test_array<std::int32_t>({64, 128, 129}),
+      test_array<float>({64, 128, 129}),
+      test_array<double>({64, 128, 129})};
+  std::vector<std::string> assets = asset_arrays();
+  if (assets.empty()) {
+    std::cout << "(" << ASSETS_DIR << " not found: run from the repository "
+              << "root to include the test assets)" << std::endl;
+  }
+
+  for (auto &codec : npy::registered_codecs()) {
+    bench_codec(*codec, "test arrays", large, 4 * scale, total);
+    if (!assets.empty()) {
+      bench_codec(*codec, "test assets", assets, 1000 * scale, total);
+    }
+  }
+
+  // printing the total ensures none of the work can be optimised away
+  std::cout << "(checksum " << total << ")" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+#include <filesystem>
+
+#include "libnpy_bench.h"
+
+namespace {
+const std::string TEMP_NPZ = "bench_npz_lookup.npz";
+
+std::string member_name(std::size_t index) {
+  return "member" + std::to_string(index);
+}
+
+void bench_archive(std::size_t num_members, std::size_t scale,
+                   std::size_t &total) {
+  {
+    npy::tensor<std::uint8_t> tensor({1});
+    npy::npzfilewriter npz(TEMP_NPZ);
+    for (std::size_t i = 0; i < num_members; ++i) {
+      npz.write(member_name(i), tensor);
+    }
+  }
+
+  std::string suffix = "(" + std::to_string(num_members) + ")";
+
+  // opening reads and indexes the whole central directory
+  std::size_t open_iterations = std::max<std::size_t>(1, 100000 / num_members);
+  bench::measure("open" + suffix, open_iterations * scale, [&]() {
+    npy::npzfilereader reader(TEMP_NPZ);
+    total += reader.contains("member0.npy") ? 1 : 0;
+  });
+
+  // a lazy reader only reads the directory, and finds a single member by
+  // scanning it
+  std::string last = member_name(num_members - 1);
+  bench::measure("open_lazy" + suffix, open_iterations * scale, [&]() {
+    npy::npzfilereader reader(TEMP_NPZ, true);
+    total += reader.data_offset(last);
+  });
+
+  npy::npzfilereader reader(TEMP_NPZ);
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < 1024; ++i) {
+    names.push_back(member_name((i * 7919) % num_members));
+  }
+
+  std::size_t next = 0;
+  bench::measure("contains" + suffix, 1000000 * scale, [&]() {
+    total += reader.contains(names[next]) ? 0 : 1;
+    next = (next + 1) % names.size();
+  });
+
+  // names without the suffix are also looked up with it
+  bench::measure("data_offset" + suffix, 100000 * scale, [&]() {
+    total += reader.data_offset(names[next]);
+    next = (next + 1) % names.size();
+  });
+
+  // the keys are only sorted when they are first asked for
+  bench::measure("open_keys" + suffix, 1 * scale, [&]() {
+    npy::npzfilereader fresh(TEMP_NPZ);
+    total += fresh.keys().size();
+  });
+
+  reader.close();
+  std::filesystem::remove(TEMP_NPZ);
+}
+} // namespace
+
+int bench_npz_lookup(std::size_t scale) {
+  std::size_t total = 0;
+
+  bench_archive(1000, scale, total);
+  bench_archive(100000, scale, total);
+  bench_archive(1000000, scale, total);
+
+  std::cout << "(checksum " << total << ")" << std::endl;
+  return EXIT_SUCCESS;
+}
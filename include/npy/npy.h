@@ -19,14 +19,24 @@
 #define _NPY_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #define NPY_VERSION_MAJOR 2
@@ -125,6 +135,11 @@ struct boolean {
   }
 };
 
+/// @brief Returns the data type which corresponds to a C++ value type.
+/// @tparam T the value type (e.g. float, std::int32_t, npy::boolean)
+/// @return the data type
+template <typename T> data_type_t dtype_of();
+
 /// @brief Convert a data type and endianness to a NPY dtype string.
 /// @param dtype the data type
 /// @param endian the endianness. Defaults to the current endianness of the
@@ -138,6 +153,12 @@ const std::string &to_dtype(data_type_t dtype,
 /// @return a pair of data type and endianness corresponding to the input
 const std::pair<data_type_t, endian_t> &from_dtype(const std::string &dtype);
 
+/// @brief Returns the number of bytes used to store a single element of a
+/// NPY dtype (e.g. 4 for "<f4", or 48 for "<U12").
+/// @param dtype the NPY dtype string
+/// @return the size of an element in bytes
+std::size_t itemsize(const std::string &dtype);
+
 std::ostream &operator<<(std::ostream &os, const endian_t &obj);
 std::ostream &operator<<(std::ostream &os, const data_type_t &obj);
 
@@ -146,7 +167,7 @@ struct header_info {
   /// Constructor.
   /// @param dictionary a Python-encoded dictionary containing the header
   /// information
-  explicit header_info(const std::string &dictionary);
+  explicit header_info(std::string_view dictionary);
 
   /// Constructor
   header_info(data_type_t dtype, npy::endian_t endianness, bool fortran_order,
@@ -170,6 +191,61 @@ struct header_info {
   std::size_t max_element_length;
 };
 
+/// @brief Returns the number of bytes used to store a single element of the
+/// data described by an NPY header.
+/// @param info the header information
+/// @return the size of an element in bytes
+std::size_t itemsize(const header_info &info);
+
+/// @brief A range of indices along one axis of a tensor, equivalent to
+/// `start:stop:step` in Python.
+/// @details As in Python, the range includes @ref start but not @ref stop, and
+/// both are clipped to the size of the axis. Negative indices and steps are
+/// not supported. The default slice covers the entire axis.
+struct slice {
+  /// @brief Constructor for a slice covering an entire axis.
+  slice() : slice(0, std::numeric_limits<size_t>::max()) {}
+
+  /// @brief Constructor.
+  /// @param start the first index in the range
+  /// @param stop the index after the end of the range
+  /// @param step the distance between indices in the range
+  slice(size_t start, size_t stop, size_t step = 1)
+      : start(start), stop(stop), step(step) {}
+
+  /// The first index in the range
+  size_t start;
+
+  /// The index after the end of the range
+  size_t stop;
+
+  /// The distance between indices in the range
+  size_t step;
+};
+
+/// @brief Returns the shape of a slice of a tensor.
+/// @param info the header information of the tensor
+/// @param slices the slice to take along each axis. If there are fewer slices
+/// than axes, the remaining axes are taken in their entirety.
+/// @return the shape of the result
+std::vector<size_t> slice_shape(const header_info &info,
+                                const std::vector<slice> &slices);
+
+/// @brief Visits each contiguous run of elements in the stored data of a
+/// tensor which is part of a slice.
+/// @details The runs are visited in storage order (i.e. respecting
+/// @ref header_info::fortran_order), which is also the order of the elements
+/// of the slice when stored in the same order. Runs along axes which are
+/// taken in their entirety are merged, so that the number of runs (and hence
+/// seeks) is as small as possible.
+/// @param info the header information of the tensor
+/// @param slices the slice to take along each axis
+/// @param visit function called with the offset (in elements, from the start
+/// of the data) and length (in elements) of each run
+void for_each_slice_run(
+    const header_info &info, const std::vector<slice> &slices,
+    const std::function<void(std::uint64_t offset, size_t count)> &visit);
+
 /// @brief Writes an NPY header to the provided stream.
 /// @param output the output stream
 /// @param dtype the NPY-encoded dtype string (includes data type and
@@ -178,11 +254,18 @@ struct header_info {
 /// major) order
 /// @param shape a sequence of values indicating the shape of each dimension of
 /// the tensor
+/// @param alignment the header is padded with spaces so that the data which
+/// follows it starts at a multiple of this many bytes (a multiple of 64).
+/// Version 2.0 of the format is used if the padded header is too long for
+/// version 1.0. Note that by default numpy refuses to load headers longer
+/// than 10,000 bytes, so alignments beyond 8192 need `max_header_size` to be
+/// raised in `numpy.load`.
 /// @sa npy::to_dtype
 template <typename CHAR>
 void write_npy_header(std::basic_ostream<CHAR> &output,
                       const std::string &dtype, bool fortran_order,
-                      const std::vector<size_t> &shape) {
+                      const std::vector<size_t> &shape,
+                      size_t alignment = 64) {
   std::ostringstream buff;
   buff << "{'descr': '" << dtype;
   buff << "', 'fortran_order': " << (fortran_order ? "True" : "False");
@@ -200,20 +283,49 @@ void write_npy_header(std::basic_ostream<CHAR> &output,
 
   buff << "), }";
   std::string dictionary = buff.str();
-  auto dict_length = dictionary.size() + 1;
-  std::string end = "\n";
-  auto header_length = dict_length + STATIC_HEADER_LENGTH;
-  if (header_length % 64 != 0) {
-    header_length = ((header_length / 64) + 1) * 64;
-    dict_length = header_length - STATIC_HEADER_LENGTH;
-    end = std::string(dict_length - dictionary.length(), ' ');
-    end.back() = '\n';
-  }
-
-  const char header[STATIC_HEADER_LENGTH] = {
-      static_cast<char>(0x93),        'N', 'U', 'M', 'P', 'Y', 0x01, 0x00,
-      static_cast<char>(dict_length), 0x00};
-  output.write(header, STATIC_HEADER_LENGTH);
+  if (alignment == 0 || alignment % 64 != 0) {
+    throw std::invalid_argument("alignment must be a multiple of 64");
+  }
+
+  // the dictionary is padded with spaces and terminated with a newline so
+  // that the data starts at a multiple of the alignment
+  auto padded_length = [&](size_t prefix_length) {
+    size_t header_length = prefix_length + dictionary.size() + 1;
+    header_length = (header_length + alignment - 1) / alignment * alignment;
+    return header_length - prefix_length;
+  };
+
+  // version 1.0 stores the length of the dictionary in two bytes, and
+  // versions 2.0 (for long headers) and 3.0 (for headers which are UTF-8
+  // rather than latin-1 encoded) in four
+  bool ascii = std::all_of(dictionary.begin(), dictionary.end(), [](char c) {
+    return static_cast<unsigned char>(c) < 0x80;
+  });
+  std::uint8_t version = 1;
+  size_t length_bytes = 2;
+  size_t dict_length = padded_length(STATIC_HEADER_LENGTH);
+  if (!ascii || dict_length > 0xFFFF) {
+    version = ascii ? 2 : 3;
+    length_bytes = 4;
+    dict_length = padded_length(STATIC_HEADER_LENGTH + 2);
+  }
+
+  if (dict_length > 0xFFFFFFFF) {
+    throw std::invalid_argument("Header is too long");
+  }
+
+  std::string end(dict_length - dictionary.size(), ' ');
+  end.back() = '\n';
+
+  const char magic[] = {static_cast<char>(0x93), 'N', 'U', 'M', 'P', 'Y',
+                        static_cast<char>(version), 0x00};
+  char length[4];
+  for (size_t i = 0; i < length_bytes; ++i) {
+    length[i] = static_cast<char>((dict_length >> (8 * i)) & 0xFF);
+  }
+
+  output.write(magic, sizeof(magic));
+  output.write(length, length_bytes);
   output.write(reinterpret_cast<const CHAR *>(dictionary.data()),
                dictionary.length());
   output.write(reinterpret_cast<const CHAR *>(end.data()), end.length());
@@ -236,16 +348,19 @@ void write_values(std::basic_ostream<CHAR> &output, const T *data_ptr,
 /// @param output the output stream
 /// @param tensor the tensor
 /// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
 template <typename T, typename CHAR>
 void save(std::basic_ostream<CHAR> &output, const T &tensor,
-          endian_t endianness = npy::endian_t::NATIVE) {
+          endian_t endianness = npy::endian_t::NATIVE,
+          size_t alignment = 64) {
   std::vector<size_t> shape;
   for (size_t d = 0; d < tensor.ndim(); ++d) {
     shape.push_back(tensor.shape(d));
   }
 
   write_npy_header(output, tensor.dtype(endianness), tensor.fortran_order(),
-                   shape);
+                   shape, alignment);
   tensor.save(output, endianness);
 };
 
@@ -256,10 +371,38 @@ void save(std::basic_ostream<CHAR> &output, const T &tensor,
 /// @param output the output stream
 /// @param tensor the tensor
 /// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
 template <typename T, template <typename> class TENSOR, typename CHAR>
 void save(std::basic_ostream<CHAR> &output, const TENSOR<T> &tensor,
-          endian_t endianness = npy::endian_t::NATIVE) {
-  save<TENSOR<T>, CHAR>(output, tensor, endianness);
+          endian_t endianness = npy::endian_t::NATIVE,
+          size_t alignment = 64) {
+  save<TENSOR<T>, CHAR>(output, tensor, endianness, alignment);
+}
+
+/// @brief Returns the number of bytes which @ref npy::save will write for a
+/// tensor, i.e. the size of the NPY header plus the size of the data.
+/// @tparam T the tensor type
+/// @param tensor the tensor
+/// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
+/// @return the size of the NPY file in bytes
+template <typename T>
+std::uint64_t saved_size(const T &tensor,
+                         endian_t endianness = npy::endian_t::NATIVE,
+                         size_t alignment = 64) {
+  std::vector<size_t> shape;
+  std::uint64_t num_elements = 1;
+  for (size_t d = 0; d < tensor.ndim(); ++d) {
+    shape.push_back(tensor.shape(d));
+    num_elements *= tensor.shape(d);
+  }
+
+  std::string dtype = tensor.dtype(endianness);
+  std::ostringstream header;
+  write_npy_header(header, dtype, tensor.fortran_order(), shape, alignment);
+  return header.str().size() + num_elements * itemsize(dtype);
 }
 
 /// @brief Saves a tensor to the provided location on disk.
@@ -267,15 +410,18 @@ void save(std::basic_ostream<CHAR> &output, const TENSOR<T> &tensor,
 /// @param path a path to a valid location on disk
 /// @param tensor the tensor
 /// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
 template <typename T>
 void save(const std::string &path, T &tensor,
-          endian_t endianness = npy::endian_t::NATIVE) {
+          endian_t endianness = npy::endian_t::NATIVE,
+          size_t alignment = 64) {
   std::ofstream output(path, std::ios::out | std::ios::binary);
   if (!output.is_open()) {
     throw std::invalid_argument("path");
   }
 
-  save<T>(output, tensor, endianness);
+  save<T>(output, tensor, endianness, alignment);
 };
 
 /// @brief Saves a tensor to the provided location on disk.
@@ -284,10 +430,255 @@ void save(const std::string &path, T &tensor,
 /// @param path a path to a valid location on disk
 /// @param tensor the tensor
 /// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
 template <typename T, template <typename> class TENSOR>
 void save(const std::string &path, T &tensor,
-          endian_t endianness = npy::endian_t::NATIVE) {
-  save<TENSOR<T>>(path, tensor, endianness);
+          endian_t endianness = npy::endian_t::NATIVE,
+          size_t alignment = 64) {
+  save<TENSOR<T>>(path, tensor, endianness, alignment);
+};
+
+class directbuf;
+
+/// @brief Output stream which writes a new file on disk while bypassing the
+/// page cache (`O_DIRECT` on Linux, `F_NOCACHE` on macOS and
+/// `FILE_FLAG_NO_BUFFERING` on Windows).
+/// @details Data is staged in an aligned buffer and written in whole blocks
+/// of @ref ALIGNMENT bytes. Whenever the data written so far fills whole
+/// blocks, a large write from a suitably aligned pointer is passed to the
+/// operating system without being copied. If the file system does not
+/// support direct I/O, the file is written normally and its pages are
+/// dropped from the cache once it is closed.
+class odirectstream : public std::ostream {
+public:
+  /// @brief The alignment of file offsets, sizes and memory used for direct
+  /// writes.
+  static const size_t ALIGNMENT = 4096;
+
+  /// @brief Constructor. Creates (or truncates) the file.
+  /// @param path path to the file on disk
+  explicit odirectstream(const std::filesystem::path &path);
+
+  /// @brief Destructor. Closes the file if @ref close has not been called,
+  /// ignoring any errors.
+  ~odirectstream();
+
+  /// @brief Writes any staged data and closes the file, trimming it to the
+  /// number of bytes written. Throws if any write failed.
+  void close();
+
+private:
+  std::unique_ptr<directbuf> m_buffer;
+};
+
+/// @brief Saves a tensor to the provided location on disk without passing it
+/// through the page cache.
+/// @details This is intended for very large tensors (e.g. checkpoints) which
+/// would otherwise evict more useful data from the cache. By default the
+/// header is padded so that the values start at a multiple of
+/// @ref odirectstream::ALIGNMENT bytes, and so tensors whose values are
+/// stored at an aligned address are written straight from their own memory.
+/// @tparam T the tensor type
+/// @param path a path to a valid location on disk
+/// @param tensor the tensor
+/// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
+template <typename T>
+void save_direct(const std::string &path, const T &tensor,
+                 endian_t endianness = npy::endian_t::NATIVE,
+                 size_t alignment = odirectstream::ALIGNMENT) {
+  std::vector<size_t> shape;
+  for (size_t d = 0; d < tensor.ndim(); ++d) {
+    shape.push_back(tensor.shape(d));
+  }
+
+  odirectstream output(path);
+  write_npy_header(output, tensor.dtype(endianness), tensor.fortran_order(),
+                   shape, alignment);
+  tensor.save(output, endianness);
+  output.close();
+}
+
+/// @brief Saves a tensor to the provided location on disk without passing it
+/// through the page cache.
+/// @tparam T the data type
+/// @tparam TENSOR the tensor type
+/// @param path a path to a valid location on disk
+/// @param tensor the tensor
+/// @param endianness the endianness to use in saving the tensor
+/// @param alignment the values start at a multiple of this many bytes from
+/// the start of the file (a multiple of 64)
+/// @sa npy::save_direct
+template <typename T, template <typename> class TENSOR>
+void save_direct(const std::string &path, const TENSOR<T> &tensor,
+                 endian_t endianness = npy::endian_t::NATIVE,
+                 size_t alignment = odirectstream::ALIGNMENT) {
+  save_direct<TENSOR<T>>(path, tensor, endianness, alignment);
+}
+
+/// @brief Writes an NPY file which grows along its first axis, one or more
+/// rows at a time.
+/// @details Space for the header is reserved when the file is created, and
+/// the shape in it is rewritten in place whenever the appender is flushed.
+/// The data is always written before the header which describes it, so the
+/// file is a valid NPY file after every flush, even if the process is
+/// stopped part way through a later append.
+/// @tparam T the data type
+template <typename T> class npyappender {
+public:
+  static_assert(!std::is_same<T, std::wstring>::value,
+                "Unicode rows vary in size and cannot be appended");
+
+  /// @brief Constructor.
+  /// @param path the path to the new file
+  /// @param row_shape the shape of each row, i.e. the shape of the tensor
+  /// without its first axis (which may be empty for a vector)
+  /// @param endianness the endianness to use in writing the data
+  /// @param alignment the values start at a multiple of this many bytes from
+  /// the start of the file (a multiple of 64)
+  npyappender(const std::string &path, const std::vector<size_t> &row_shape,
+              endian_t endianness = npy::endian_t::NATIVE,
+              size_t alignment = 64)
+      : m_output(path, std::ios::out | std::ios::binary),
+        m_row_shape(row_shape), m_row_size(1), m_rows(0),
+        m_endianness(endianness), m_dtype(to_dtype(dtype_of<T>(), endianness)),
+        m_header_length(0) {
+    if (!m_output.is_open()) {
+      throw std::invalid_argument("path");
+    }
+
+    for (auto dim : m_row_shape) {
+      m_row_size *= dim;
+    }
+
+    // the header is sized for the longest possible row count, so that it
+    // can always be rewritten in place. Using the resulting length as the
+    // alignment pads every shorter header out to exactly the same length.
+    std::ostringstream reserved;
+    write_npy_header(reserved, m_dtype, false,
+                     shape(std::numeric_limits<size_t>::max()),
+                     alignment);
+    m_header_length = reserved.str().size();
+    write_header();
+    m_output.flush();
+  }
+
+  /// @brief Destructor. Closes the file if it is still open.
+  ~npyappender() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  npyappender(const npyappender &) = delete;
+  npyappender &operator=(const npyappender &) = delete;
+
+  /// @brief The shape of each row.
+  const std::vector<size_t> &row_shape() const { return m_row_shape; }
+
+  /// @brief The number of rows appended so far.
+  size_t rows() const { return m_rows; }
+
+  /// @brief Whether the file is still open for appending.
+  bool is_open() const { return m_output.is_open(); }
+
+  /// @brief Appends rows to the file.
+  /// @details The rows are not described by the header (and so are not
+  /// visible to readers) until the next call to @ref flush or @ref close.
+  /// @param values the values of the rows, in row-major order
+  /// @param num_rows the number of rows
+  void append(const T *values, size_t num_rows) {
+    if (!m_output.is_open()) {
+      throw std::runtime_error("NPY file is closed");
+    }
+
+    write_values(m_output, values, num_rows * m_row_size, m_endianness);
+    if (!m_output) {
+      throw std::runtime_error("Error writing to file");
+    }
+
+    m_rows += num_rows;
+  }
+
+  /// @brief Appends a tensor to the file.
+  /// @details The tensor must either have the shape of a single row, or be
+  /// a block of rows with the row shape along its remaining axes.
+  /// @tparam TENSOR the tensor type
+  /// @param tensor the row or rows to append
+  template <typename TENSOR> void append(const TENSOR &tensor) {
+    if (tensor.fortran_order()) {
+      throw std::invalid_argument("tensor must be in C order");
+    }
+
+    std::vector<size_t> tensor_shape;
+    for (size_t d = 0; d < tensor.ndim(); ++d) {
+      tensor_shape.push_back(tensor.shape(d));
+    }
+
+    if (tensor_shape == m_row_shape) {
+      append(tensor.data(), 1);
+      return;
+    }
+
+    if (tensor_shape.empty() ||
+        !std::equal(tensor_shape.begin() + 1, tensor_shape.end(),
+                    m_row_shape.begin(), m_row_shape.end())) {
+      throw std::invalid_argument("tensor does not match the row shape");
+    }
+
+    append(tensor.data(), tensor_shape[0]);
+  }
+
+  /// @brief Updates the header with the number of rows appended so far and
+  /// flushes the file.
+  void flush() {
+    if (!m_output.is_open()) {
+      throw std::runtime_error("NPY file is closed");
+    }
+
+    // the rows must be on disk before the header which refers to them
+    m_output.flush();
+    m_output.seekp(0);
+    write_header();
+    m_output.seekp(0, std::ios::end);
+    m_output.flush();
+    if (!m_output) {
+      throw std::runtime_error("Error writing to file");
+    }
+  }
+
+  /// @brief Flushes and closes the file. Further appends will throw.
+  void close() {
+    if (!m_output.is_open()) {
+      return;
+    }
+
+    flush();
+    m_output.close();
+  }
+
+private:
+  std::ofstream m_output;
+  std::vector<size_t> m_row_shape;
+  size_t m_row_size;
+  size_t m_rows;
+  endian_t m_endianness;
+  std::string m_dtype;
+  size_t m_header_length;
+
+  std::vector<size_t> shape(size_t rows) const {
+    std::vector<size_t> result = {rows};
+    result.insert(result.end(), m_row_shape.begin(), m_row_shape.end());
+    return result;
+  }
+
+  void write_header() {
+    write_npy_header(m_output, m_dtype, false, shape(m_rows),
+                     m_header_length);
+  }
 };
 
 /// @brief Read an NPY header from the provided stream.
@@ -295,28 +686,45 @@ void save(const std::string &path, T &tensor,
 /// @return the header information
 template <typename CHAR>
 header_info read_npy_header(std::basic_istream<CHAR> &input) {
-  std::uint8_t header[STATIC_HEADER_LENGTH];
-  input.read(reinterpret_cast<CHAR *>(header), STATIC_HEADER_LENGTH);
-  assert(header[0] == 0x93);
-  assert(header[1] == 'N');
-  assert(header[2] == 'U');
-  assert(header[3] == 'M');
-  assert(header[4] == 'P');
-  assert(header[5] == 'Y');
-  size_t dict_length = 0;
-  if (header[6] == 0x01 && header[7] == 0x00) {
-    dict_length = header[8] | (header[9] << 8);
-  } else if (header[6] == 0x02 && header[7] == 0x00) {
-    std::uint8_t extra[2];
-    input.read(reinterpret_cast<CHAR *>(extra), 2);
-    dict_length =
-        header[8] | (header[9] << 8) | (extra[0] << 16) | (extra[1] << 24);
-  }
-
-  std::vector<CHAR> buffer(dict_length);
-  input.read(buffer.data(), dict_length);
-  std::string dictionary(buffer.begin(), buffer.end());
-  return header_info(dictionary);
+  std::uint8_t header[STATIC_HEADER_LENGTH + 2];
+  if (!input.read(reinterpret_cast<CHAR *>(header), STATIC_HEADER_LENGTH)) {
+    throw std::runtime_error("NPY header is truncated");
+  }
+
+  const std::uint8_t magic[] = {0x93, 'N', 'U', 'M', 'P', 'Y'};
+  if (!std::equal(magic, magic + sizeof(magic), header)) {
+    throw std::runtime_error("Invalid NPY magic string");
+  }
+
+  std::uint8_t version = header[6];
+  if (version < 1 || version > 3) {
+    throw std::runtime_error("Unsupported NPY format version: " +
+                             std::to_string(version));
+  }
+
+  std::uint32_t dict_length = header[8] | (header[9] << 8);
+  if (version > 1) {
+    if (!input.read(reinterpret_cast<CHAR *>(header + STATIC_HEADER_LENGTH),
+                    2)) {
+      throw std::runtime_error("NPY header is truncated");
+    }
+
+    dict_length |= static_cast<std::uint32_t>(header[10]) << 16;
+    dict_length |= static_cast<std::uint32_t>(header[11]) << 24;
+  }
+
+  // each thread reuses one buffer for the dictionary, unless it is unusually
+  // large (e.g. padded to a large alignment)
+  const size_t MAX_REUSED_LENGTH = 64 * 1024;
+  thread_local std::string reused;
+  std::string large;
+  std::string &buffer = dict_length <= MAX_REUSED_LENGTH ? reused : large;
+  buffer.resize(dict_length);
+  if (!input.read(reinterpret_cast<CHAR *>(buffer.data()), dict_length)) {
+    throw std::runtime_error("NPY header is truncated");
+  }
+
+  return header_info(std::string_view(buffer.data(), dict_length));
 }
 
 /// @brief Read values from the provided stream.
@@ -330,6 +738,61 @@ template <typename T, typename CHAR>
 void read_values(std::basic_istream<CHAR> &input, T *data_ptr,
                  size_t num_elements, const header_info &info);
 
+class preadbuf;
+
+/// @brief A file which is read at explicit offsets (e.g. with `pread`), rather
+/// than from a shared position, so that any number of threads can read from it
+/// at once.
+class pread_file {
+public:
+  /// @brief Constructor. Opens the file for reading.
+  /// @param path path to the file on disk
+  explicit pread_file(const std::filesystem::path &path);
+
+  /// @brief Destructor. Closes the file.
+  ~pread_file();
+
+  pread_file(const pread_file &) = delete;
+  pread_file &operator=(const pread_file &) = delete;
+
+  /// @brief The size of the file in bytes.
+  std::uint64_t size() const { return m_size; }
+
+  /// @brief Reads bytes from the file.
+  /// @param offset the offset in the file of the first byte to read
+  /// @param buffer the destination buffer
+  /// @param size the number of bytes to read
+  /// @return the number of bytes read, which is only less than @p size if
+  /// the end of the file was reached
+  std::size_t read(std::uint64_t offset, char *buffer, std::size_t size) const;
+
+private:
+  std::intptr_t m_handle;
+  std::uint64_t m_size;
+};
+
+/// @brief Input stream over a @ref pread_file.
+/// @details Each stream has its own position and buffer, so several streams
+/// over the same file can be used from different threads at once.
+class ipreadstream : public std::istream {
+public:
+  /// @brief The default size of the buffer.
+  static const size_t WINDOW_SIZE = 64 * 1024;
+
+  /// @brief Constructor.
+  /// @param file the file to read, positioned at its start
+  /// @param window_size the size of the buffer, i.e. of each read from the
+  /// file (larger reads bypass it)
+  explicit ipreadstream(std::shared_ptr<const pread_file> file,
+                        size_t window_size = WINDOW_SIZE);
+
+  /// @brief Destructor.
+  ~ipreadstream();
+
+private:
+  std::unique_ptr<preadbuf> m_buffer;
+};
+
 template <typename T, typename CHAR> T load(std::basic_istream<CHAR> &input) {
   header_info info = read_npy_header(input);
   return T::load(input, info);
@@ -342,11 +805,7 @@ template <typename T, typename CHAR> T load(std::basic_istream<CHAR> &input) {
 /// @param path a valid location on the disk
 /// @return an object of type TENSOR<T> read from the stream
 template <typename T> T load(const std::string &path) {
-  std::ifstream input(path, std::ios::in | std::ios::binary);
-  if (!input.is_open()) {
-    throw std::invalid_argument("path");
-  }
-
+  ipreadstream input(std::make_shared<const pread_file>(path));
   return load<T>(input);
 }
 
@@ -373,15 +832,257 @@ template <typename CHAR> header_info peek(std::basic_istream<CHAR> &input) {
 /// @return the NPY header information
 header_info peek(const std::string &path);
 
+class thread_pool;
+
+/// @brief A fixed pool of threads on which files are loaded ahead of use.
+/// @details This is the non-template part of @ref batch_loader.
+class io_pool {
+public:
+  /// @brief Constructor.
+  /// @param num_threads the number of I/O threads. If zero, one thread per
+  /// hardware thread is used.
+  explicit io_pool(std::size_t num_threads);
+
+  /// @brief Destructor. Waits for any submitted tasks to finish.
+  ~io_pool();
+
+  io_pool(const io_pool &) = delete;
+  io_pool &operator=(const io_pool &) = delete;
+
+  /// @brief The number of I/O threads.
+  std::size_t size() const;
+
+  /// @brief Runs a task on one of the I/O threads.
+  /// @param task the task to run
+  void submit(std::function<void()> task);
+
+private:
+  std::unique_ptr<thread_pool> m_pool;
+};
+
+/// @brief Loads a sequence of NPY files, reading ahead on a pool of I/O
+/// threads.
+/// @details Files are opened, parsed and loaded in the background, at most
+/// `read_ahead` of them at a time, and handed back in the order of the paths
+/// by @ref next or @ref for_each. This hides the latency of opening and
+/// reading many small files from the code which consumes the tensors. If a
+/// file cannot be loaded, the exception is thrown by the call to @ref next
+/// which would have returned it.
+/// @tparam T the tensor type
+template <typename T> class batch_loader {
+public:
+  /// @brief Constructor. Starts loading the first files immediately.
+  /// @param paths the paths of the NPY files to load, in order
+  /// @param num_threads the number of I/O threads. If zero, one thread per
+  /// hardware thread is used.
+  /// @param read_ahead the maximum number of files which are loaded but not
+  /// yet returned. If zero, twice the number of I/O threads.
+  explicit batch_loader(std::vector<std::string> paths,
+                        std::size_t num_threads = 0,
+                        std::size_t read_ahead = 0)
+      : m_paths(std::move(paths)), m_next(0), m_submitted(0),
+        m_pool(num_threads) {
+    m_read_ahead = read_ahead > 0 ? read_ahead : 2 * m_pool.size();
+    fill();
+  }
+
+  /// @brief The total number of files.
+  std::size_t size() const { return m_paths.size(); }
+
+  /// @brief Whether there are more tensors to return.
+  bool has_next() const { return m_next < m_paths.size(); }
+
+  /// @brief Returns the next tensor, waiting for it to load if needed.
+  /// @return the tensor loaded from the next path
+  T next() {
+    if (!has_next()) {
+      throw std::runtime_error("No more files to load");
+    }
+
+    std::future<T> result = std::move(m_pending.front());
+    m_pending.pop_front();
+    m_next += 1;
+    fill();
+    return result.get();
+  }
+
+  /// @brief Passes each of the remaining tensors, in order, to a callback.
+  /// @tparam F the callback type, invocable with a `T&&`
+  /// @param callback the function to call with each tensor
+  template <typename F> void for_each(F callback) {
+    while (has_next()) {
+      callback(next());
+    }
+  }
+
+private:
+  void fill() {
+    while (m_submitted < m_paths.size() && m_pending.size() < m_read_ahead) {
+      auto task = std::make_shared<std::packaged_task<T()>>(
+          [path = m_paths[m_submitted]]() { return load<T>(path); });
+      m_pending.push_back(task->get_future());
+      m_pool.submit([task]() { (*task)(); });
+      m_submitted += 1;
+    }
+  }
+
+  std::vector<std::string> m_paths;
+  std::deque<std::future<T>> m_pending;
+  std::size_t m_next;
+  std::size_t m_submitted;
+  std::size_t m_read_ahead;
+  // declared last so that it is destroyed first, finishing any tasks which
+  // are still in flight while the rest of the loader is intact
+  io_pool m_pool;
+};
+
 /// @brief Enumeration indicating the compression method to use for data in the
 /// NPZ archive.
 enum class compression_method_t : std::uint16_t {
   /// Store the data with no compression
   STORED = 0,
   /// Use the DEFLATE algorithm to compress the data
-  DEFLATED = 8
+  DEFLATED = 8,
+  /// Use the Zstandard algorithm to compress the data. Only available if the
+  /// library was built with LIBNPY_USE_ZSTD. Python's zipfile module (and so
+  /// numpy) can only read these files from Python 3.14 onwards.
+  ZSTD = 93
+};
+
+/// @brief Class which compresses the data of an NPZ entry incrementally.
+class codec_compressor {
+public:
+  virtual ~codec_compressor() = default;
+
+  /// @brief Compresses a block of bytes, writing any output produced to the
+  /// stream the compressor was created with.
+  /// @param data pointer to the bytes
+  /// @param size the number of bytes
+  virtual void write(const char *data, std::size_t size) = 0;
+
+  /// @brief Ends the compressed stream and writes any pending output.
+  virtual void finish() = 0;
+};
+
+/// @brief Class which decompresses the data of an NPZ entry incrementally.
+class codec_decompressor {
+public:
+  virtual ~codec_decompressor() = default;
+
+  /// @brief Decompresses as much of the input as will fit into the output.
+  /// @param input the compressed bytes. Advanced past the consumed bytes.
+  /// @param input_size the number of compressed bytes. Reduced by the number
+  /// of consumed bytes.
+  /// @param output the output buffer
+  /// @param output_size the size of the output buffer
+  /// @return the number of bytes written to the output buffer
+  virtual std::size_t decompress(const char *&input, std::size_t &input_size,
+                                 char *output, std::size_t output_size) = 0;
+
+  /// @brief Whether the end of the compressed stream has been reached. If the
+  /// format cannot tell (e.g. it is a series of frames), this returns false
+  /// and the stream ends with the uncompressed data.
+  virtual bool finished() const { return false; }
 };
 
+/// @brief Class which implements a compression method for NPZ entries.
+/// @details Every codec compresses and decompresses whole buffers. The
+/// @ref flags say which of the optional operations it also implements: those
+/// it does not will throw @c std::logic_error. Codecs are shared between
+/// threads, so all of these methods must be thread safe.
+class codec {
+public:
+  /// @brief Flag indicating that the codec implements @ref compressor and
+  /// @ref decompressor. Without it, entries are buffered in memory.
+  static const std::uint32_t STREAMING = 1;
+
+  /// @brief Flag indicating that the codec implements @ref compress_block,
+  /// so that large entries can be compressed as blocks in parallel.
+  static const std::uint32_t BLOCKS = 2;
+
+  /// @brief Flag indicating that whole buffers are processed faster than
+  /// streams. Entries which are read or written whole are then buffered in
+  /// memory and passed to @ref compress or @ref decompress in one call, even
+  /// if the codec can also stream.
+  static const std::uint32_t ONE_SHOT = 4;
+
+  virtual ~codec() = default;
+
+  /// @brief The ZIP compression method implemented by the codec.
+  virtual compression_method_t method() const = 0;
+
+  /// @brief The name of the codec (e.g. the library which implements it).
+  virtual std::string name() const = 0;
+
+  /// @brief The operations supported by the codec (see @ref STREAMING and
+  /// @ref BLOCKS).
+  virtual std::uint32_t flags() const = 0;
+
+  /// @brief The version of the ZIP specification needed to extract entries
+  /// compressed with the codec, multiplied by ten (e.g. 20 for 2.0).
+  virtual std::uint16_t version_needed() const { return 20; }
+
+  /// @brief Upper bound on the compressed size of a number of bytes.
+  /// @param size the number of uncompressed bytes
+  /// @return the maximum number of compressed bytes
+  virtual std::uint64_t bound(std::uint64_t size) const = 0;
+
+  /// @brief Compresses a buffer.
+  /// @param data pointer to the bytes
+  /// @param size the number of bytes
+  /// @param level the compression level (0 for the default)
+  /// @return the compressed bytes
+  virtual std::string compress(const char *data, std::size_t size,
+                               int level) const = 0;
+
+  /// @brief Decompresses a buffer.
+  /// @param bytes the compressed bytes
+  /// @param uncompressed_size the size of the uncompressed data
+  /// @return the uncompressed bytes
+  virtual std::string decompress(std::string &&bytes,
+                                 std::uint64_t uncompressed_size) const = 0;
+
+  /// @brief Compresses one block of a larger buffer, such that the compressed
+  /// blocks can be concatenated in order to produce a single valid stream.
+  /// @param data pointer to the bytes
+  /// @param size the number of bytes
+  /// @param last whether this is the last block of the buffer
+  /// @param level the compression level (0 for the default)
+  /// @return the compressed bytes
+  virtual std::string compress_block(const char *data, std::size_t size,
+                                     bool last, int level) const;
+
+  /// @brief Creates a compressor which writes to a stream.
+  /// @param output the stream which receives the compressed bytes
+  /// @param level the compression level (0 for the default)
+  /// @return the compressor
+  virtual std::unique_ptr<codec_compressor> compressor(std::ostream &output,
+                                                       int level) const;
+
+  /// @brief Creates a decompressor.
+  /// @return the decompressor
+  virtual std::unique_ptr<codec_decompressor> decompressor() const;
+};
+
+/// @brief Registers a codec, replacing any codec already registered for its
+/// compression method.
+/// @details Codecs for DEFLATED (and for ZSTD, if the library was built with
+/// LIBNPY_USE_ZSTD) are registered by default. The DEFLATED codec uses
+/// libdeflate for whole entries if the library was built with
+/// LIBNPY_USE_LIBDEFLATE, and miniz otherwise. Entries with a compression
+/// method can only be read or written while it has a codec.
+/// @param codec the codec
+void register_codec(std::shared_ptr<const codec> codec);
+
+/// @brief Finds the codec registered for a compression method.
+/// @param method the compression method
+/// @return the codec, or nullptr if there is none (as for STORED)
+std::shared_ptr<const codec> find_codec(compression_method_t method);
+
+/// @brief Lists the registered codecs, in order of compression method.
+/// @return the codecs
+std::vector<std::shared_ptr<const codec>> registered_codecs();
+
 /// @brief Struct representing a file in the NPZ archive.
 struct file_entry {
   /// The name of the file
@@ -403,20 +1104,236 @@ struct file_entry {
   bool check(const file_entry &other) const;
 };
 
+/// @brief Index of the files in an NPZ archive by name.
+/// @details The index holds the bytes of the central directory, which are
+/// read all at once, and decodes each entry when it is first needed. Names
+/// are found through hash tables keyed on views of the names in those bytes,
+/// so a lookup takes constant time and allocates nothing. A lazy index does
+/// no work until it is used, and its first lookup scans the directory rather
+/// than building the tables, so opening an archive to read one tensor costs
+/// little more than reading the directory. The sorted list of names is only
+/// built the first time it is asked for.
+class file_index {
+public:
+  /// @brief Constructor.
+  /// @param directory the bytes of the central directory
+  /// @param num_entries the number of entries in the directory
+  /// @param lazy whether to defer indexing and decoding the entries until
+  /// they are used (otherwise every entry is decoded, and so checked, now)
+  file_index(std::string &&directory, std::uint64_t num_entries,
+             bool lazy = false);
+
+  file_index(const file_index &) = delete;
+  file_index &operator=(const file_index &) = delete;
+
+  /// @brief Returns whether there is a file with exactly the specified name.
+  /// @param filename the name of the file in the archive
+  bool contains(std::string_view filename) const;
+
+  /// @brief Finds the entry with exactly the specified name.
+  /// @param filename the name of the file in the archive
+  /// @return the entry, or nullptr if there is no such file
+  const file_entry *find(std::string_view filename) const;
+
+  /// @brief Finds the entry for a tensor, which may be named with or
+  /// without the ".npy" suffix.
+  /// @param filename the name of the tensor in the archive
+  /// @return the entry, or nullptr if there is no such tensor
+  const file_entry *find_npy(std::string_view filename) const;
+
+  /// @brief The names of the files in the archive, sorted.
+  const std::vector<std::string> &keys() const;
+
+private:
+  /// @brief Builds the hash tables, if they have not been built already.
+  void index() const;
+
+  /// @brief Finds the position in the directory of the header for a file.
+  /// @param filename the name of the file
+  /// @param npy whether to also look for the name with the ".npy" suffix
+  /// @return the position, or std::string::npos if there is no such file
+  size_t locate(std::string_view filename, bool npy) const;
+
+  /// @brief Returns the entry at a position, decoding it if needed.
+  const file_entry *entry(size_t position) const;
+
+  std::string m_directory;
+  std::uint64_t m_num_entries;
+  mutable std::atomic<bool> m_used;
+  mutable std::once_flag m_index_flag;
+  /// The position of each header in the directory, by name
+  mutable std::unordered_map<std::string_view, size_t> m_names;
+  /// Headers of files ending in ".npy", by their name without the suffix
+  mutable std::unordered_map<std::string_view, size_t> m_stems;
+  mutable std::mutex m_entries_mutex;
+  /// The entries decoded so far, by position
+  mutable std::unordered_map<size_t, file_entry> m_entries;
+  mutable std::once_flag m_keys_flag;
+  mutable std::vector<std::string> m_keys;
+};
+
+/// @brief Description of a tensor in an NPZ archive, as returned by
+/// @ref npy::npzfilereader::manifest.
+struct member_info {
+  /// The directory entry for the file, which holds its name, sizes and
+  /// compression method
+  file_entry entry;
+  /// The absolute offset in the archive of the (possibly compressed) data
+  /// of the file, i.e. the first byte after its local header
+  std::uint64_t data_offset;
+  /// The size of the NPY header at the start of the uncompressed data. For a
+  /// STORED file, the values start at `data_offset + header_size`.
+  std::uint64_t header_size;
+  /// The header of the tensor
+  header_info header;
+};
+
+class imemberbuf;
+class omemberbuf;
+class obytebuf;
+class compression_queue;
+class memory_map;
+template <typename T> class tensor;
+template <typename T> class mmap_tensor;
+template <typename T, typename CHAR>
+tensor<T> load_slice(std::basic_istream<CHAR> &input,
+                     const std::vector<slice> &slices);
+
+/// @brief Input stream over the data of a single file in an NPZ archive.
+/// @details The data is read from the archive, and inflated if it is
+/// compressed, incrementally as it is consumed. Large reads (e.g. by
+/// @ref npy::read_values) are inflated directly into the destination buffer,
+/// so reading a tensor through this stream requires only a small fixed window
+/// of memory beyond the tensor itself. The exception is an entry whose codec
+/// has @ref npy::codec::ONE_SHOT, which a stream with at least the default
+/// window decompresses whole, into a buffer of its uncompressed size, when it
+/// is first read. The CRC32 checksum is accumulated as the data is read and
+/// checked by @ref verify.
+class imemberstream : public std::istream {
+public:
+  /// @brief The default size of the buffers.
+  static const size_t WINDOW_SIZE = 64 * 1024;
+
+  /// @brief Constructor.
+  /// @param archive the archive stream, positioned at the start of the data
+  /// for the file (i.e. immediately after its local header)
+  /// @param entry the directory entry for the file
+  /// @param window_size the size of the buffers for the compressed and
+  /// uncompressed data. A small window suits reading only the start of the
+  /// file, e.g. its header.
+  imemberstream(std::istream &archive, const file_entry &entry,
+                size_t window_size = WINDOW_SIZE);
+
+  /// @brief Destructor.
+  ~imemberstream();
+
+  /// @brief Consumes any remaining data for the file and verifies its size
+  /// and CRC32 checksum.
+  /// @details Any error encountered while reading or inflating the data is
+  /// rethrown here.
+  void verify();
+
+private:
+  std::unique_ptr<imemberbuf> m_buffer;
+};
+
+/// @brief Output stream which writes the data of a single file to an NPZ
+/// archive.
+/// @details The local header for the file is written on construction, after
+/// which the data is compressed (if required) and written to the archive
+/// incrementally as it is produced, accumulating the CRC32 checksum as it
+/// goes. If the codec has @ref npy::codec::ONE_SHOT, the data is instead
+/// buffered and compressed in one call by @ref close. Calling @ref close
+/// completes the file and rewrites the local header in place with the final
+/// sizes and checksum, which requires the archive stream to be seekable.
+class omemberstream : public std::ostream {
+public:
+  /// @brief Constructor.
+  /// @param archive the archive stream, positioned where the file should
+  /// start
+  /// @param filename the name of the file in the archive
+  /// @param compression how the file should be compressed
+  /// @param size the expected size of the uncompressed data, which is used to
+  /// reserve space for ZIP64 extensions in the local header if needed
+  /// @param level the compression level (0 for the default)
+  omemberstream(std::ostream &archive, const std::string &filename,
+                compression_method_t compression, std::uint64_t size,
+                int level = 0);
+
+  /// @brief Destructor.
+  ~omemberstream();
+
+  /// @brief Completes the file and updates its local header.
+  /// @details Any error encountered while compressing or writing the data is
+  /// rethrown here.
+  /// @return the directory entry for the file
+  file_entry close();
+
+private:
+  std::unique_ptr<omemberbuf> m_buffer;
+};
+
+/// @brief Output stream which appends to a string that can be released
+/// without copying it.
+/// @details The writers use this to serialise an entry before it is queued
+/// for compression, so that the bytes are moved to the queue rather than
+/// copied out of a @c std::ostringstream.
+class obytestream : public std::ostream {
+public:
+  /// @brief Constructor.
+  /// @param capacity the number of bytes to reserve
+  explicit obytestream(std::size_t capacity = 0);
+
+  /// @brief Destructor.
+  ~obytestream();
+
+  /// @brief Releases the bytes written so far, leaving the stream empty.
+  /// @return the bytes
+  std::string release();
+
+private:
+  std::unique_ptr<obytebuf> m_buffer;
+};
+
 /// @brief Class which handles writing of an NPZ to an in-memory string stream.
 class npzstringwriter {
 public:
   /// @brief Constructor.
   /// @param compression how the entries should be compressed
   /// @param endianness the endianness to use in writing the entries
+  /// @param num_threads the number of worker threads used to compress the
+  /// entries. If zero, each entry is compressed on the calling thread as it
+  /// is written. Otherwise, each entry is serialised and queued to be
+  /// compressed in the background, and entries are added to the archive in
+  /// the order they were written, so that the output is identical.
+  /// @param block_size if non-zero (and @p num_threads is non-zero), entries
+  /// larger than this many bytes are split into blocks which are compressed
+  /// and checksummed in parallel. The blocks form a single valid DEFLATE
+  /// stream, but it is slightly larger than (and so not identical to) the
+  /// stream produced by compressing the entry as a whole.
   npzstringwriter(
       compression_method_t compression = compression_method_t::STORED,
-      endian_t endianness = npy::endian_t::NATIVE);
+      endian_t endianness = npy::endian_t::NATIVE,
+      std::size_t num_threads = 0, std::size_t block_size = 0);
 
   /// @brief Destructor. This will call @ref npy::npzstringwriter::close, if it
-  /// has not been called already.
+  /// has not been called already, ignoring any errors. Call @ref close
+  /// explicitly to see them.
   ~npzstringwriter();
 
+  /// @brief Sets the level at which subsequent entries are compressed.
+  /// @details The level is passed to the codec, and its meaning depends upon
+  /// the compression method. ZSTD accepts levels from 1 (fastest) to 22
+  /// (smallest, but much slower) as well as negative levels which trade yet
+  /// more of the ratio for speed, and its default (0) is level 3. The
+  /// built-in DEFLATED codec accepts levels from 1 to 10, and its default is
+  /// level 6. If the library was built with LIBNPY_USE_LIBDEFLATE, whole
+  /// entries accept levels up to 12, but entries which are split into blocks
+  /// (see the constructor) are still compressed by miniz, which treats
+  /// levels above 10 as 10.
+  /// @param level the compression level
+  void set_compression_level(int level);
+
   /// @brief Returns the contents of the string stream as a string.
   /// @return the state of the in-memory stream
   std::string str() const;
@@ -431,13 +1348,22 @@ public:
   /// @param tensor the tensor to write
   template <typename T>
   void write(const std::string &filename, const T &tensor) {
+    write(filename, tensor, m_compression_method);
+  }
+
+  /// @brief Write a tensor to the NPZ archive with a different compression
+  /// method from the other entries.
+  /// @tparam T the tensor type
+  /// @param filename the name of the file in the archive
+  /// @param tensor the tensor to write
+  /// @param compression how the entry should be compressed
+  template <typename T>
+  void write(const std::string &filename, const T &tensor,
+             compression_method_t compression) {
     if (m_closed) {
       throw std::runtime_error("Stream is closed");
     }
 
-    std::ostringstream output;
-    save<T>(output, tensor, m_endianness);
-
     std::string suffix = ".npy";
     std::string name = filename;
     if (name.size() < 4 ||
@@ -445,56 +1371,107 @@ public:
       name += ".npy";
     }
 
-    write_file(name, output.str());
+    if (m_queue) {
+      obytestream output(saved_size(tensor, m_endianness));
+      save<T>(output, tensor, m_endianness);
+      write_file(name, output.release(), compression);
+      return;
+    }
+
+    omemberstream output(m_output, name, compression,
+                         saved_size(tensor, m_endianness), m_compression_level);
+    save<T>(output, tensor, m_endianness);
+    m_entries.push_back(output.close());
   }
 
 private:
-  /// Write a file to the stream.
+  /// @brief Queues a file to be compressed and written to the stream.
   /// @param filename the name of the file
   /// @param bytes the file data
-  void write_file(const std::string &filename, std::string &&bytes);
+  /// @param compression how the file should be compressed
+  void write_file(const std::string &filename, std::string &&bytes,
+                  compression_method_t compression);
 
   bool m_closed;
   std::ostringstream m_output;
   compression_method_t m_compression_method;
+  int m_compression_level;
   endian_t m_endianness;
   std::vector<file_entry> m_entries;
+  std::unique_ptr<compression_queue> m_queue;
 };
 
 /// @brief Class which handles writing of an NPZ archive to disk.
+/// @details In append mode the files already in the archive are kept: new
+/// files are written over the old central directory, and a directory listing
+/// both is written on close, so adding a file costs time in proportion to its
+/// own size rather than that of the archive. Writing a file with the name of
+/// one which is already in the archive replaces it (the old data is left in
+/// place but is no longer referenced). The archive cannot be read until the
+/// writer has been closed.
 class npzfilewriter {
 public:
   /// @brief Constructor.
   /// @param path path to the output NPZ file
   /// @param compression how the entries should be compressed
   /// @param endianness the endianness to use in writing the entries
+  /// @param num_threads the number of worker threads used to compress the
+  /// entries (see @ref npy::npzstringwriter::npzstringwriter)
+  /// @param block_size the size of the blocks into which large entries are
+  /// split for compression (see @ref npy::npzstringwriter::npzstringwriter)
+  /// @param append whether to add to the archive at @p path, if it exists,
+  /// rather than replacing it (see @ref npy::npzfilewriter)
   npzfilewriter(const std::string &path,
                 compression_method_t compression = compression_method_t::STORED,
-                endian_t endianness = npy::endian_t::NATIVE);
+                endian_t endianness = npy::endian_t::NATIVE,
+                std::size_t num_threads = 0, std::size_t block_size = 0,
+                bool append = false);
 
   /// @brief Constructor.
   /// @param path path to the output NPZ file
   /// @param compression how the entries should be compressed
   /// @param endianness the endianness to use in writing the entries
+  /// @param num_threads the number of worker threads used to compress the
+  /// entries (see @ref npy::npzstringwriter::npzstringwriter)
+  /// @param block_size the size of the blocks into which large entries are
+  /// split for compression (see @ref npy::npzstringwriter::npzstringwriter)
+  /// @param append whether to add to the archive at @p path, if it exists,
+  /// rather than replacing it (see @ref npy::npzfilewriter)
   npzfilewriter(const char *path,
                 compression_method_t compression = compression_method_t::STORED,
-                endian_t endianness = npy::endian_t::NATIVE);
+                endian_t endianness = npy::endian_t::NATIVE,
+                std::size_t num_threads = 0, std::size_t block_size = 0,
+                bool append = false);
 
   /// @brief Constructor.
   /// @param path path to the output NPZ file
   /// @param compression how the entries should be compressed
   /// @param endianness the endianness to use in writing the entries
+  /// @param num_threads the number of worker threads used to compress the
+  /// entries (see @ref npy::npzstringwriter::npzstringwriter)
+  /// @param block_size the size of the blocks into which large entries are
+  /// split for compression (see @ref npy::npzstringwriter::npzstringwriter)
+  /// @param append whether to add to the archive at @p path, if it exists,
+  /// rather than replacing it (see @ref npy::npzfilewriter)
   npzfilewriter(const std::filesystem::path &path,
                 compression_method_t compression = compression_method_t::STORED,
-                endian_t endianness = npy::endian_t::NATIVE);
+                endian_t endianness = npy::endian_t::NATIVE,
+                std::size_t num_threads = 0, std::size_t block_size = 0,
+                bool append = false);
 
   /// @brief Destructor. This will call @ref npy::npzfilewriter::close, if it
-  /// has not been called already.
+  /// has not been called already, ignoring any errors. Call @ref close
+  /// explicitly to see them.
   ~npzfilewriter();
 
   /// @brief Returns whether the NPZ file is open.
   bool is_open() const;
 
+  /// @brief Sets the level at which subsequent entries are compressed (see
+  /// @ref npy::npzstringwriter::set_compression_level).
+  /// @param level the compression level
+  void set_compression_level(int level);
+
   /// @brief Writes the directory and end-matter of the NPZ file, and closes the
   /// file. Further writes will fail.
   void close();
@@ -505,13 +1482,22 @@ public:
   /// @param tensor the tensor to write
   template <typename T>
   void write(const std::string &filename, const T &tensor) {
+    write(filename, tensor, m_compression_method);
+  }
+
+  /// @brief Write a tensor to the NPZ archive with a different compression
+  /// method from the other entries.
+  /// @tparam T the tensor type
+  /// @param filename the name of the file in the archive
+  /// @param tensor the tensor to write
+  /// @param compression how the entry should be compressed
+  template <typename T>
+  void write(const std::string &filename, const T &tensor,
+             compression_method_t compression) {
     if (m_closed) {
       throw std::runtime_error("Stream is closed");
     }
 
-    std::ostringstream output;
-    save<T>(output, tensor, m_endianness);
-
     std::string suffix = ".npy";
     std::string name = filename;
     if (name.size() < 4 ||
@@ -519,20 +1505,36 @@ public:
       name += ".npy";
     }
 
-    write_file(name, output.str());
+    if (m_queue) {
+      obytestream output(saved_size(tensor, m_endianness));
+      save<T>(output, tensor, m_endianness);
+      write_file(name, output.release(), compression);
+      return;
+    }
+
+    omemberstream output(m_output, name, compression,
+                         saved_size(tensor, m_endianness), m_compression_level);
+    save<T>(output, tensor, m_endianness);
+    m_entries.push_back(output.close());
   }
 
 private:
-  /// @brief Write a file to the stream.
+  /// @brief Queues a file to be compressed and written to the stream.
   /// @param filename the name of the file
   /// @param bytes the file data
-  void write_file(const std::string &filename, std::string &&bytes);
+  /// @param compression how the file should be compressed
+  void write_file(const std::string &filename, std::string &&bytes,
+                  compression_method_t compression);
 
   bool m_closed;
   std::ofstream m_output;
+  /// The path of the archive, if it is being appended to
+  std::filesystem::path m_path;
   compression_method_t m_compression_method;
+  int m_compression_level;
   endian_t m_endianness;
   std::vector<file_entry> m_entries;
+  std::unique_ptr<compression_queue> m_queue;
 };
 
 /// @brief Class handling reading of an NPZ from an in-memory string stream.
@@ -555,6 +1557,8 @@ public:
   bool contains(const std::string &filename);
 
   /// @brief Returns the header for a specified tensor.
+  /// @details Only the start of the tensor is read (and inflated, if it is
+  /// compressed), so its CRC32 checksum is not checked.
   /// @param filename the name of the tensor in the archive
   /// @return the header for the tensor
   header_info peek(const std::string &filename);
@@ -568,8 +1572,10 @@ public:
   /// @return an instance of T read from the archive
   /// @sa npy::tensor
   template <typename T> T read(const std::string &filename) {
-    std::istringstream stream(read_file(filename));
-    return load<T>(stream);
+    imemberstream stream(m_input, seek_file(filename));
+    T tensor = load<T>(stream);
+    stream.verify();
+    return tensor;
   }
 
   template <typename T, template <typename> class TENSOR>
@@ -578,17 +1584,16 @@ public:
   }
 
 private:
-  /// @brief Reads the bytes for a file from the archive.
+  /// @brief Positions the input at the start of the data for a file.
   /// @param filename the name of the file
-  /// @return the raw file bytes
-  std::string read_file(const std::string &filename);
+  /// @return the directory entry for the file
+  const file_entry &seek_file(const std::string &filename);
 
   /// @brief Read all entries from the directory.
   void read_entries();
 
   std::istringstream m_input;
-  std::map<std::string, file_entry> m_entries;
-  std::vector<std::string> m_keys;
+  std::unique_ptr<file_index> m_entries;
 };
 
 /// @brief Class handling reading of an NPZ from a file on disk.
@@ -596,15 +1601,21 @@ class npzfilereader {
 public:
   /// @brief Constructor.
   /// @param path path to the input NPZ file
-  npzfilereader(const std::string &path);
+  /// @param lazy whether to defer decoding the central directory until
+  /// its entries are used (see @ref npy::file_index)
+  npzfilereader(const std::string &path, bool lazy = false);
 
   /// @brief Constructor.
   /// @param path path to the input NPZ file
-  npzfilereader(const char *path);
+  /// @param lazy whether to defer decoding the central directory until
+  /// its entries are used (see @ref npy::file_index)
+  npzfilereader(const char *path, bool lazy = false);
 
   /// @brief Constructor.
   /// @param path path to the input NPZ file
-  npzfilereader(const std::filesystem::path &path);
+  /// @param lazy whether to defer decoding the central directory until
+  /// its entries are used (see @ref npy::file_index)
+  npzfilereader(const std::filesystem::path &path, bool lazy = false);
 
   /// @brief Whether the NPZ file is open.
   bool is_open() const;
@@ -621,10 +1632,23 @@ public:
   bool contains(const std::string &filename);
 
   /// @brief Returns the header for a specified tensor.
+  /// @details Only the start of the tensor is read (and inflated, if it is
+  /// compressed), so its CRC32 checksum is not checked.
   /// @param filename the name of the tensor in the archive
   /// @return the header for the tensor
   header_info peek(const std::string &filename);
 
+  /// @brief Describes every tensor in the archive.
+  /// @details Each tensor is peeked (see @ref peek), so only its local header
+  /// and the start of its data are read, whatever its size. This is useful
+  /// for planning work (e.g. budgeting memory) before any tensors are read.
+  /// This method will throw an exception if any file in the archive is not a
+  /// valid NPY, as @ref peek would for that file.
+  /// @param num_threads the number of threads on which to read the headers,
+  /// or 0 to read them all on the calling thread
+  /// @return a description of each tensor, in the order of @ref keys
+  std::vector<member_info> manifest(size_t num_threads = 0);
+
   /// @brief Read a tensor from the archive.
   /// @details This method will throw an exception if
   /// the tensor does not exist, or if the data type of the tensor does not
@@ -633,8 +1657,11 @@ public:
   /// @param filename the name of the tensor in the archive
   /// @return an instance of T read from the archive
   template <typename T> T read(const std::string &filename) {
-    std::istringstream stream(read_file(filename));
-    return load<T>(stream);
+    ipreadstream input(file());
+    imemberstream stream(input, seek_file(input, filename));
+    T tensor = load<T>(stream);
+    stream.verify();
+    return tensor;
   }
 
   /// @brief Read a tensor from the archive.
@@ -647,21 +1674,94 @@ public:
   /// @return an instance of TENSOR<T> read from the archive
   template <typename T, template <typename> class TENSOR>
   TENSOR<T> read(const std::string &filename) {
-    read<TENSOR<T>>(filename);
+    return read<TENSOR<T>>(filename);
+  }
+
+  /// @brief Returns the absolute offset of the values of a tensor within the
+  /// archive file.
+  /// @details Only tensors which are STORED (i.e. not compressed) have their
+  /// values at a fixed location in the archive, and so this method will throw
+  /// an exception for compressed tensors. Together with @ref peek, this allows
+  /// the values to be read directly from the archive file.
+  /// @param filename the name of the tensor in the archive
+  /// @return the offset of the first value of the tensor
+  std::uint64_t data_offset(const std::string &filename);
+
+  /// @brief Maps a STORED tensor from the archive into memory without copying
+  /// it.
+  /// @details The archive file is mapped once and shared by all of the
+  /// tensors mapped from it. As well as the requirements of
+  /// @ref npy::mmap_tensor, the values must be suitably aligned for @p T in
+  /// the file, which is not guaranteed by archives written by `np.savez`.
+  /// Use @ref read_slice to read part of a tensor which cannot be mapped.
+  /// @tparam T the data type
+  /// @param filename the name of the tensor in the archive
+  /// @return a read-only view of the tensor
+  template <typename T> mmap_tensor<T> map(const std::string &filename) {
+    ipreadstream input(file());
+    header_info info = seek_data(input, filename);
+    std::uint64_t offset = static_cast<std::uint64_t>(input.tellg());
+    return mmap_tensor<T>(archive_map(), static_cast<size_t>(offset), info);
+  }
+
+  /// @brief Reads part of a STORED tensor from the archive, reading only the
+  /// data which is needed.
+  /// @details This method will throw @c std::out_of_range if the header of
+  /// the tensor describes more values than its file holds.
+  /// @tparam T the data type
+  /// @param filename the name of the tensor in the archive
+  /// @param slices the slice to take along each axis
+  /// @return the sliced tensor
+  /// @sa npy::load_slice
+  template <typename T>
+  tensor<T> read_slice(const std::string &filename,
+                       const std::vector<slice> &slices) {
+    ipreadstream input(file());
+    seek_stored_file(input, filename);
+    return load_slice<T>(input, slices);
   }
 
 private:
-  /// @brief Reads the bytes for a file from the archive.
-  /// @param filename the name of the file
-  /// @return the raw file bytes
-  std::string read_file(const std::string &filename);
+  /// @brief Returns the archive file, throwing if the reader is closed.
+  std::shared_ptr<const pread_file> file() const;
 
-  /// @brief Read all entries from the directory.
-  void read_entries();
+  /// @brief Positions an input stream over the archive at the start of the
+  /// data for a file.
+  /// @param input a stream over the archive
+  /// @param filename the name of the file
+  /// @return the directory entry for the file
+  const file_entry &seek_file(std::istream &input,
+                              const std::string &filename) const;
+
+  /// @brief Positions an input stream over the archive at the start of the
+  /// data for a STORED file, throwing if the file is compressed or if its
+  /// tensor extends past the end of the file.
+  /// @param input a stream over the archive
+  /// @param filename the name of the file
+  void seek_stored_file(std::istream &input, const std::string &filename) const;
 
-  std::ifstream m_input;
-  std::map<std::string, file_entry> m_entries;
-  std::vector<std::string> m_keys;
+  /// @brief Positions an input stream over the archive at the start of the
+  /// values of a STORED tensor.
+  /// @param input a stream over the archive
+  /// @param filename the name of the tensor in the archive
+  /// @return the header for the tensor
+  header_info seek_data(std::istream &input,
+                        const std::string &filename) const;
+
+  /// @brief Returns the mapping of the archive file, mapping it if needed.
+  std::shared_ptr<const memory_map> archive_map();
+
+  /// @brief Read the directory.
+  /// @param lazy whether to defer decoding the entries
+  void read_entries(bool lazy);
+
+  std::filesystem::path m_path;
+  /// guards m_file, which close() resets while other threads may be reading
+  mutable std::mutex m_file_mutex;
+  std::shared_ptr<const pread_file> m_file;
+  std::mutex m_map_mutex;
+  std::shared_ptr<const memory_map> m_map;
+  std::unique_ptr<file_index> m_entries;
 };
 
 /// @brief The default tensor class.
@@ -991,7 +2091,7 @@ private:
   std::vector<T> m_values;
 
   /// @brief Returns the data type for this tensor.
-  static data_type_t get_dtype();
+  static data_type_t get_dtype() { return dtype_of<T>(); }
 
   /// @brief Gets the size of a tensor given its shape
   static size_t get_size(const std::vector<size_t> &shape) {
@@ -1048,6 +2148,225 @@ inline std::string tensor<std::wstring>::dtype(endian_t endianness) const {
   return ">U" + std::to_string(max_length);
 }
 
+/// @brief Class representing a read-only memory mapping of a file on disk.
+/// @details The mapping is released when the object is destroyed. Objects
+/// which hand out pointers into the mapping (e.g. @ref npy::mmap_tensor) hold
+/// it by shared pointer so that it outlives them.
+class memory_map {
+public:
+  /// @brief Constructor. Maps the entire file into memory.
+  /// @param path path to the file on disk
+  explicit memory_map(const std::filesystem::path &path);
+
+  /// @brief Destructor. Unmaps the file.
+  ~memory_map();
+
+  memory_map(const memory_map &) = delete;
+  memory_map &operator=(const memory_map &) = delete;
+
+  /// @brief A pointer to the start of the mapped bytes.
+  const char *data() const { return m_data; }
+
+  /// @brief The number of mapped bytes.
+  std::size_t size() const { return m_size; }
+
+private:
+  const char *m_data;
+  std::size_t m_size;
+};
+
+/// @brief A read-only tensor whose values are memory-mapped from disk.
+/// @details The NPY header is parsed as usual, but the data region of the file
+/// is not copied: @ref data returns a pointer directly into the mapping. As a
+/// result, the data must be stored in the native endianness of the machine,
+/// and unicode string tensors are not supported. Several processes mapping the
+/// same file will share a single copy in the page cache.
+/// @tparam T the data type
+template <typename T> class mmap_tensor {
+public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "mmap_tensor requires a trivially copyable value type");
+
+  /// The value type of the tensor.
+  typedef T value_type;
+  /// The const reference type of the tensor.
+  typedef const value_type &const_reference;
+  /// The const pointer type of the tensor.
+  typedef const value_type *const_pointer;
+
+  /// @brief Constructor.
+  /// @details Parses the NPY header from the file and then maps it.
+  /// @param path the path to an NPY file on disk
+  explicit mmap_tensor(const std::string &path) {
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    if (!input.is_open()) {
+      throw std::invalid_argument("path");
+    }
+
+    header_info info = read_npy_header(input);
+    std::size_t offset = static_cast<std::size_t>(input.tellg());
+    input.close();
+
+    init(std::make_shared<memory_map>(path), offset, info);
+  }
+
+  /// @brief Constructor.
+  /// @param map an existing mapping which contains the tensor data
+  /// @param offset the offset of the tensor data within the mapping
+  /// @param info the header information for the tensor
+  mmap_tensor(std::shared_ptr<const memory_map> map, std::size_t offset,
+              const header_info &info) {
+    init(std::move(map), offset, info);
+  }
+
+  /// @brief Save the tensor to the provided stream.
+  /// @param output the output stream
+  /// @param endianness the endianness to use in writing the data
+  /// @sa npy::write_values
+  void save(std::basic_ostream<char> &output, endian_t endianness) const {
+    write_values(output, m_data, m_size, endianness);
+  }
+
+  /// @brief Returns the value at the provided offset into the data buffer.
+  const T &operator[](std::size_t index) const { return m_data[index]; }
+
+  /// @brief Pointer to the beginning of the tensor in memory.
+  const T *begin() const { return m_data; }
+
+  /// @brief Pointer to the end of the tensor in memory.
+  const T *end() const { return m_data + m_size; }
+
+  /// @brief A pointer to the start of the mapped values.
+  const T *data() const { return m_data; }
+
+  /// @brief The number of elements in the tensor.
+  size_t size() const { return m_size; }
+
+  /// @brief The data type of the tensor.
+  std::string dtype(endian_t endianness) const {
+    return to_dtype(dtype(), endianness);
+  }
+
+  /// @brief The data type of the tensor.
+  data_type_t dtype() const { return dtype_of<T>(); }
+
+  /// @brief The shape of the tensor.
+  const std::vector<size_t> &shape() const { return m_shape; }
+
+  /// @brief Returns the dimensionality of the tensor at the specified index.
+  /// @param index index into the shape
+  /// @return the dimensionality at the index
+  size_t shape(int index) const { return m_shape[index]; }
+
+  /// @brief The number of dimensions of the tensor.
+  size_t ndim() const { return m_shape.size(); }
+
+  /// @brief Whether the tensor data is stored in FORTRAN, or column-major,
+  /// order.
+  bool fortran_order() const { return m_fortran_order; }
+
+private:
+  std::shared_ptr<const memory_map> m_map;
+  const T *m_data;
+  size_t m_size;
+  std::vector<size_t> m_shape;
+  bool m_fortran_order;
+
+  void init(std::shared_ptr<const memory_map> map, std::size_t offset,
+            const header_info &info) {
+    if (info.dtype != dtype()) {
+      throw std::runtime_error("requested dtype does not match stream's dtype");
+    }
+
+    if (info.endianness != endian_t::NATIVE &&
+        info.endianness != native_endian()) {
+      throw std::runtime_error("cannot map data with non-native endianness");
+    }
+
+    if (offset > map->size()) {
+      throw std::runtime_error("mapped data is truncated");
+    }
+
+    // the size is checked against the mapping one dimension at a time, as the
+    // product of the dimensions can overflow
+    std::size_t available = (map->size() - offset) / sizeof(T);
+    bool empty = std::find(info.shape.begin(), info.shape.end(), 0) !=
+                 info.shape.end();
+    m_size = empty ? 0 : 1;
+    for (auto &dim : info.shape) {
+      if (!empty && dim > available / m_size) {
+        throw std::runtime_error("mapped data is truncated");
+      }
+
+      m_size *= dim;
+    }
+
+    if ((reinterpret_cast<std::uintptr_t>(map->data()) + offset) % alignof(T)) {
+      throw std::runtime_error("mapped data is not aligned");
+    }
+
+    m_map = std::move(map);
+    m_data = reinterpret_cast<const T *>(m_map->data() + offset);
+    m_shape = info.shape;
+    m_fortran_order = info.fortran_order;
+  }
+};
+
+/// @brief Loads part of a tensor in NPY format from the provided stream,
+/// reading only the data which is needed.
+/// @details The stream must be seekable. The result has the same storage order
+/// as the data in the stream.
+/// @tparam T the data type
+/// @param input the input stream
+/// @param slices the slice to take along each axis. If there are fewer slices
+/// than axes, the remaining axes are taken in their entirety.
+/// @return the sliced tensor
+/// @sa npy::slice
+template <typename T, typename CHAR>
+tensor<T> load_slice(std::basic_istream<CHAR> &input,
+                     const std::vector<slice> &slices) {
+  header_info info = read_npy_header(input);
+  tensor<T> result(slice_shape(info, slices), info.fortran_order);
+  if (info.dtype != result.dtype()) {
+    throw std::runtime_error("requested dtype does not match stream's dtype");
+  }
+
+  std::uint64_t data_start = static_cast<std::uint64_t>(input.tellg());
+  std::uint64_t position = data_start;
+  std::uint64_t element_size = itemsize(info);
+  T *data_ptr = result.data();
+  for_each_slice_run(info, slices, [&](std::uint64_t offset, size_t count) {
+    std::uint64_t start = data_start + offset * element_size;
+    if (start != position) {
+      input.seekg(start, std::ios::beg);
+    }
+
+    read_values(input, data_ptr, count, info);
+    data_ptr += count;
+    position = start + count * element_size;
+  });
+
+  if (input.fail()) {
+    throw std::runtime_error("Error reading slice from stream");
+  }
+
+  return result;
+}
+
+/// @brief Loads part of a tensor in NPY format from the specified location on
+/// the disk, reading only the data which is needed.
+/// @tparam T the data type
+/// @param path a valid location on the disk
+/// @param slices the slice to take along each axis
+/// @return the sliced tensor
+/// @sa npy::load_slice(std::basic_istream<CHAR>&, const std::vector<slice>&)
+template <typename T>
+tensor<T> load_slice(const std::string &path,
+                     const std::vector<slice> &slices) {
+  ipreadstream input(std::make_shared<const pread_file>(path));
+  return load_slice<T>(input, slices);
+}
+
 } // namespace npy
 
 #endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "byteswap.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#define NPY_BYTESWAP_SHUFFLE
+#elif defined(__SSE2__) || defined(_M_X64) ||                                 \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NPY_BYTESWAP_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NPY_BYTESWAP_NEON
+#endif
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#define BSWAP16(x) _byteswap_ushort(x)
+#define BSWAP32(x) _byteswap_ulong(x)
+#define BSWAP64(x) _byteswap_uint64(x)
+#else
+#define BSWAP16(x) __builtin_bswap16(x)
+#define BSWAP32(x) __builtin_bswap32(x)
+#define BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+namespace {
+template <typename W> W bswap(W value);
+
+template <> std::uint16_t bswap(std::uint16_t value) {
+  return BSWAP16(value);
+}
+
+template <> std::uint32_t bswap(std::uint32_t value) {
+  return BSWAP32(value);
+}
+
+template <> std::uint64_t bswap(std::uint64_t value) {
+  return BSWAP64(value);
+}
+
+/// Scalar fallback, also used for the tail left over by the vector kernels.
+template <typename W>
+void swap_scalar(char *dst, const char *src, std::size_t num_words) {
+  for (std::size_t i = 0; i < num_words * sizeof(W); i += sizeof(W)) {
+    W value;
+    std::memcpy(&value, src + i, sizeof(W));
+    value = bswap(value);
+    std::memcpy(dst + i, &value, sizeof(W));
+  }
+}
+
+#if defined(NPY_BYTESWAP_SHUFFLE)
+template <typename W> __m128i shuffle_mask();
+
+template <> __m128i shuffle_mask<std::uint16_t>() {
+  return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+}
+
+template <> __m128i shuffle_mask<std::uint32_t>() {
+  return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+}
+
+template <> __m128i shuffle_mask<std::uint64_t>() {
+  return _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+}
+
+template <typename W>
+std::size_t swap_vector(char *dst, const char *src, std::size_t num_bytes) {
+  std::size_t i = 0;
+  __m128i mask = shuffle_mask<W>();
+#if defined(__AVX2__)
+  __m256i mask256 = _mm256_broadcastsi128_si256(mask);
+  for (; i + 32 <= num_bytes; i += 32) {
+    __m256i value =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_shuffle_epi8(value, mask256));
+  }
+#endif
+  for (; i + 16 <= num_bytes; i += 16) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_shuffle_epi8(value, mask));
+  }
+
+  return i;
+}
+#elif defined(NPY_BYTESWAP_SSE2)
+/// SSE2 has no byte shuffle, so words are reversed by swapping the bytes of
+/// each 16-bit lane and then reordering the lanes within the word.
+__m128i swap16(__m128i value) {
+  return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+}
+
+template <typename W> __m128i swap_lanes(__m128i value);
+
+template <> __m128i swap_lanes<std::uint16_t>(__m128i value) {
+  return value;
+}
+
+template <> __m128i swap_lanes<std::uint32_t>(__m128i value) {
+  value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_shufflehi_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+template <> __m128i swap_lanes<std::uint64_t>(__m128i value) {
+  value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shufflehi_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+template <typename W>
+std::size_t swap_vector(char *dst, const char *src, std::size_t num_bytes) {
+  std::size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    value = swap16(swap_lanes<W>(value));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), value);
+  }
+
+  return i;
+}
+#elif defined(NPY_BYTESWAP_NEON)
+template <typename W> uint8x16_t swap_neon(uint8x16_t value);
+
+template <> uint8x16_t swap_neon<std::uint16_t>(uint8x16_t value) {
+  return vrev16q_u8(value);
+}
+
+template <> uint8x16_t swap_neon<std::uint32_t>(uint8x16_t value) {
+  return vrev32q_u8(value);
+}
+
+template <> uint8x16_t swap_neon<std::uint64_t>(uint8x16_t value) {
+  return vrev64q_u8(value);
+}
+
+template <typename W>
+std::size_t swap_vector(char *dst, const char *src, std::size_t num_bytes) {
+  std::size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16) {
+    uint8x16_t value =
+        vld1q_u8(reinterpret_cast<const std::uint8_t *>(src + i));
+    vst1q_u8(reinterpret_cast<std::uint8_t *>(dst + i), swap_neon<W>(value));
+  }
+
+  return i;
+}
+#else
+template <typename W>
+std::size_t swap_vector(char *, const char *, std::size_t) {
+  return 0;
+}
+#endif
+
+template <typename W>
+void swap(char *dst, const char *src, std::size_t num_words) {
+  std::size_t num_bytes = num_words * sizeof(W);
+  std::size_t done = swap_vector<W>(dst, src, num_bytes);
+  swap_scalar<W>(dst + done, src + done, (num_bytes - done) / sizeof(W));
+}
+} // namespace
+
+namespace npy {
+void npy_byteswap(void *dst, const void *src, std::size_t num_words,
+                  std::size_t word_size) {
+  char *out = static_cast<char *>(dst);
+  const char *in = static_cast<const char *>(src);
+  switch (word_size) {
+  case 1:
+    if (out != in) {
+      std::memcpy(out, in, num_words);
+    }
+    break;
+
+  case 2:
+    swap<std::uint16_t>(out, in, num_words);
+    break;
+
+  case 4:
+    swap<std::uint32_t>(out, in, num_words);
+    break;
+
+  case 8:
+    swap<std::uint64_t>(out, in, num_words);
+    break;
+
+  default:
+    throw std::invalid_argument("word_size");
+  }
+}
+} // namespace npy
@@ -0,0 +1,29 @@
+// ----------------------------------------------------------------------------
+//
+// byteswap.h -- bulk byte order reversal for non-native endian data
+//
+// Copyright (C) 2021 Matthew Johnson
+//
+// For conditions of distribution and use, see copyright notice in LICENSE
+//
+// ----------------------------------------------------------------------------
+
+#ifndef _BYTESWAP_H_
+#define _BYTESWAP_H_
+
+#include <cstddef>
+
+namespace npy {
+/** Reverse the byte order of each word in a buffer. The source and
+ *  destination may be the same buffer, in which case the swap is done in
+ *  place, but they must not otherwise overlap.
+ *  \param dst the destination buffer
+ *  \param src the source buffer
+ *  \param num_words the number of words in the buffer
+ *  \param word_size the size of each word in bytes (1, 2, 4 or 8)
+ */
+void npy_byteswap(void *dst, const void *src, std::size_t num_words,
+                  std::size_t word_size);
+} // namespace npy
+
+#endif
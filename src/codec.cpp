@@ -0,0 +1,276 @@
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "npy/npy.h"
+#include "zip.h"
+
+#ifdef LIBNPY_USE_LIBDEFLATE
+#include "oneshot.h"
+#endif
+
+#ifdef LIBNPY_USE_ZSTD
+#include "zstandard.h"
+#endif
+
+namespace {
+using namespace npy;
+
+class deflate_compressor : public codec_compressor {
+public:
+  deflate_compressor(std::ostream &output, int level)
+      : m_deflater(output, level) {}
+
+  void write(const char *data, std::size_t size) override {
+    m_deflater.write(data, size);
+  }
+
+  void finish() override { m_deflater.finish(); }
+
+private:
+  npy_deflater m_deflater;
+};
+
+class deflate_decompressor : public codec_decompressor {
+public:
+  std::size_t decompress(const char *&input, std::size_t &input_size,
+                         char *output, std::size_t output_size) override {
+    return m_inflater.decompress(input, input_size, output, output_size);
+  }
+
+  bool finished() const override { return m_inflater.finished(); }
+
+private:
+  npy_inflater m_inflater;
+};
+
+/// DEFLATE through miniz, at levels from 1 to 10.
+class deflate_codec : public codec {
+public:
+  compression_method_t method() const override {
+    return compression_method_t::DEFLATED;
+  }
+
+  std::string name() const override { return "miniz"; }
+
+  std::uint32_t flags() const override { return STREAMING | BLOCKS; }
+
+  std::uint64_t bound(std::uint64_t size) const override {
+    return npy_deflate_bound(size);
+  }
+
+  std::string compress(const char *data, std::size_t size,
+                       int level) const override {
+    return compress_block(data, size, true, level);
+  }
+
+  std::string decompress(std::string &&bytes,
+                         std::uint64_t uncompressed_size) const override {
+    // the size is known, so the data is inflated straight into its buffer
+    std::string output(static_cast<std::size_t>(uncompressed_size), '\0');
+    npy_inflater inflater;
+    const char *input = bytes.data();
+    std::size_t input_size = bytes.size();
+    std::size_t produced =
+        inflater.decompress(input, input_size, output.data(), output.size());
+    if (produced != output.size()) {
+      throw std::runtime_error("Compressed data is truncated");
+    }
+
+    return output;
+  }
+
+  std::string compress_block(const char *data, std::size_t size, bool last,
+                             int level) const override {
+    return npy_deflate_block(data, size, last, level);
+  }
+
+  std::unique_ptr<codec_compressor> compressor(std::ostream &output,
+                                               int level) const override {
+    return std::make_unique<deflate_compressor>(output, level);
+  }
+
+  std::unique_ptr<codec_decompressor> decompressor() const override {
+    return std::make_unique<deflate_decompressor>();
+  }
+};
+
+#ifdef LIBNPY_USE_LIBDEFLATE
+/// DEFLATE through libdeflate for whole buffers, which is quicker than miniz
+/// but cannot stream or flush, so miniz still produces streams and blocks.
+class libdeflate_codec : public deflate_codec {
+public:
+  std::string name() const override { return "libdeflate"; }
+
+  std::uint32_t flags() const override {
+    return STREAMING | BLOCKS | ONE_SHOT;
+  }
+
+  std::string compress(const char *data, std::size_t size,
+                       int level) const override {
+    return npy_oneshot_deflate(data, size, level);
+  }
+
+  std::string decompress(std::string &&bytes,
+                         std::uint64_t uncompressed_size) const override {
+    return npy_oneshot_inflate(bytes, uncompressed_size);
+  }
+};
+#endif
+
+#ifdef LIBNPY_USE_ZSTD
+class zstd_compressor : public codec_compressor {
+public:
+  zstd_compressor(std::ostream &output, int level)
+      : m_compressor(output, level) {}
+
+  void write(const char *data, std::size_t size) override {
+    m_compressor.write(data, size);
+  }
+
+  void finish() override { m_compressor.finish(); }
+
+private:
+  npy_zstd_compressor m_compressor;
+};
+
+class zstd_decompressor : public codec_decompressor {
+public:
+  std::size_t decompress(const char *&input, std::size_t &input_size,
+                         char *output, std::size_t output_size) override {
+    return m_decompressor.decompress(input, input_size, output, output_size);
+  }
+
+private:
+  npy_zstd_decompressor m_decompressor;
+};
+
+/// Zstandard through libzstd. Each block is a separate frame, and
+/// concatenated frames decompress to the concatenated data.
+class zstd_codec : public codec {
+public:
+  compression_method_t method() const override {
+    return compression_method_t::ZSTD;
+  }
+
+  std::string name() const override { return "zstd"; }
+
+  std::uint32_t flags() const override { return STREAMING | BLOCKS; }
+
+  std::uint16_t version_needed() const override {
+    return 63; // 6.3 File is compressed using Zstandard
+  }
+
+  std::uint64_t bound(std::uint64_t size) const override {
+    return npy_zstd_bound(size);
+  }
+
+  std::string compress(const char *data, std::size_t size,
+                       int level) const override {
+    return npy_zstd_compress(data, size, level);
+  }
+
+  std::string decompress(std::string &&bytes,
+                         std::uint64_t uncompressed_size) const override {
+    return npy_zstd_decompress(std::move(bytes), uncompressed_size);
+  }
+
+  std::string compress_block(const char *data, std::size_t size, bool,
+                             int level) const override {
+    return npy_zstd_compress(data, size, level);
+  }
+
+  std::unique_ptr<codec_compressor> compressor(std::ostream &output,
+                                               int level) const override {
+    return std::make_unique<zstd_compressor>(output, level);
+  }
+
+  std::unique_ptr<codec_decompressor> decompressor() const override {
+    return std::make_unique<zstd_decompressor>();
+  }
+};
+#endif
+
+/// The registered codecs, keyed by compression method.
+class codec_registry {
+public:
+  static codec_registry &instance() {
+    static codec_registry registry;
+    return registry;
+  }
+
+  void add(std::shared_ptr<const codec> codec) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_codecs[codec->method()] = std::move(codec);
+  }
+
+  std::shared_ptr<const codec> find(compression_method_t method) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_codecs.find(method);
+    return it == m_codecs.end() ? nullptr : it->second;
+  }
+
+  std::vector<std::shared_ptr<const codec>> list() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::shared_ptr<const codec>> codecs;
+    for (auto &codec : m_codecs) {
+      codecs.push_back(codec.second);
+    }
+
+    return codecs;
+  }
+
+private:
+  codec_registry() {
+#ifdef LIBNPY_USE_LIBDEFLATE
+    m_codecs[compression_method_t::DEFLATED] =
+        std::make_shared<libdeflate_codec>();
+#else
+    m_codecs[compression_method_t::DEFLATED] =
+        std::make_shared<deflate_codec>();
+#endif
+#ifdef LIBNPY_USE_ZSTD
+    m_codecs[compression_method_t::ZSTD] = std::make_shared<zstd_codec>();
+#endif
+  }
+
+  std::mutex m_mutex;
+  std::map<compression_method_t, std::shared_ptr<const codec>> m_codecs;
+};
+} // namespace
+
+namespace npy {
+std::string codec::compress_block(const char *, std::size_t, bool,
+                                  int) const {
+  throw std::logic_error("Codec does not support blocks");
+}
+
+std::unique_ptr<codec_compressor> codec::compressor(std::ostream &,
+                                                    int) const {
+  throw std::logic_error("Codec does not support streaming");
+}
+
+std::unique_ptr<codec_decompressor> codec::decompressor() const {
+  throw std::logic_error("Codec does not support streaming");
+}
+
+void register_codec(std::shared_ptr<const codec> codec) {
+  if (!codec) {
+    throw std::invalid_argument("codec");
+  }
+
+  if (codec->method() == compression_method_t::STORED) {
+    throw std::invalid_argument("STORED entries cannot have a codec");
+  }
+
+  codec_registry::instance().add(std::move(codec));
+}
+
+std::shared_ptr<const codec> find_codec(compression_method_t method) {
+  return codec_registry::instance().find(method);
+}
+
+std::vector<std::shared_ptr<const codec>> registered_codecs() {
+  return codec_registry::instance().list();
+}
+} // namespace npy
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <stdexcept>
+
+#include "npy/npy.h"
+
+#if defined(_WIN32) || defined(WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const std::size_t ALIGNMENT = npy::odirectstream::ALIGNMENT;
+const std::size_t STAGING_SIZE = 4 * 1024 * 1024;
+
+bool is_aligned(const void *ptr) {
+  return reinterpret_cast<std::uintptr_t>(ptr) % ALIGNMENT == 0;
+}
+
+/// A file opened for writing which bypasses the page cache where possible.
+class direct_file {
+public:
+  explicit direct_file(const std::filesystem::path &path);
+  ~direct_file();
+
+  direct_file(const direct_file &) = delete;
+  direct_file &operator=(const direct_file &) = delete;
+
+  /// Whether writes must be whole, aligned blocks
+  bool direct() const { return m_direct; }
+
+  void write(const char *data, std::size_t size);
+
+  /// Sets the size of the file, drops it from the cache and closes it.
+  void close(std::uint64_t size);
+
+private:
+#if defined(_WIN32) || defined(WIN32)
+  HANDLE m_handle;
+#else
+  int m_fd;
+#endif
+  bool m_direct;
+};
+
+#if defined(_WIN32) || defined(WIN32)
+direct_file::direct_file(const std::filesystem::path &path) : m_direct(true) {
+  m_handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr,
+                         CREATE_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                         nullptr);
+  if (m_handle == INVALID_HANDLE_VALUE) {
+    throw std::invalid_argument("path");
+  }
+}
+
+direct_file::~direct_file() {
+  if (m_handle != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_handle);
+  }
+}
+
+void direct_file::write(const char *data, std::size_t size) {
+  while (size > 0) {
+    DWORD step = static_cast<DWORD>(std::min<std::size_t>(size, 0x40000000));
+    DWORD actual = 0;
+    if (!WriteFile(m_handle, data, step, &actual, nullptr)) {
+      throw std::runtime_error("Error writing to file");
+    }
+
+    data += actual;
+    size -= actual;
+  }
+}
+
+void direct_file::close(std::uint64_t size) {
+  FILE_END_OF_FILE_INFO info;
+  info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+  bool success = SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &info,
+                                            sizeof(info));
+  CloseHandle(m_handle);
+  m_handle = INVALID_HANDLE_VALUE;
+  if (!success) {
+    throw std::runtime_error("Unable to set the size of the file");
+  }
+}
+#else
+direct_file::direct_file(const std::filesystem::path &path) : m_direct(false) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  m_fd = -1;
+#ifdef O_DIRECT
+  m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+  m_direct = m_fd >= 0;
+#endif
+  if (m_fd < 0) {
+    // direct I/O is not supported by this platform or file system
+    m_fd = ::open(path.c_str(), flags, 0644);
+  }
+
+  if (m_fd < 0) {
+    throw std::invalid_argument("path");
+  }
+
+#ifdef F_NOCACHE
+  ::fcntl(m_fd, F_NOCACHE, 1);
+#endif
+}
+
+direct_file::~direct_file() {
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void direct_file::write(const char *data, std::size_t size) {
+  while (size > 0) {
+    ssize_t actual = ::write(m_fd, data, size);
+    if (actual < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw std::runtime_error("Error writing to file");
+    }
+
+    data += actual;
+    size -= static_cast<std::size_t>(actual);
+  }
+}
+
+void direct_file::close(std::uint64_t size) {
+  bool success = ::ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#ifdef POSIX_FADV_DONTNEED
+  if (success && !m_direct) {
+    // the pages can only be dropped once they have been written back
+    ::fdatasync(m_fd);
+    ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+#endif
+
+  success = ::close(m_fd) == 0 && success;
+  m_fd = -1;
+  if (!success) {
+    throw std::runtime_error("Unable to set the size of the file");
+  }
+}
+#endif
+} // namespace
+
+namespace npy {
+/// Stream buffer which stages data in an aligned buffer and writes it to a
+/// direct_file in whole blocks.
+class directbuf : public std::streambuf {
+public:
+  explicit directbuf(const std::filesystem::path &path)
+      : m_file(path), m_written(0), m_closed(false),
+        m_staging(static_cast<char *>(
+            ::operator new(STAGING_SIZE, std::align_val_t(ALIGNMENT)))) {
+    setp(m_staging, m_staging + STAGING_SIZE);
+  }
+
+  ~directbuf() {
+    ::operator delete(m_staging, std::align_val_t(ALIGNMENT));
+  }
+
+  void close() {
+    if (m_closed) {
+      return;
+    }
+
+    m_closed = true;
+    if (m_error) {
+      std::rethrow_exception(m_error);
+    }
+
+    std::size_t used = static_cast<std::size_t>(pptr() - pbase());
+    std::uint64_t size = m_written + used;
+    std::size_t length = used;
+    if (m_file.direct()) {
+      // the final block is padded, and the padding trimmed off afterwards
+      length = (used + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+      std::fill(pptr(), pbase() + length, 0);
+    }
+
+    m_file.write(pbase(), length);
+    m_file.close(size);
+  }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (!safe_flush()) {
+      return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize count) override {
+    std::size_t n = static_cast<std::size_t>(count);
+    std::size_t used = static_cast<std::size_t>(pptr() - pbase());
+    if (n >= ALIGNMENT && used % ALIGNMENT == 0 && is_aligned(s)) {
+      // the data will start on a block boundary, so whole blocks of it can
+      // be written without being copied
+      if (!safe_flush()) {
+        return 0;
+      }
+
+      std::size_t direct = n / ALIGNMENT * ALIGNMENT;
+      try {
+        m_file.write(s, direct);
+      } catch (...) {
+        m_error = std::current_exception();
+        return 0;
+      }
+
+      m_written += direct;
+      return static_cast<std::streamsize>(direct) +
+             std::streambuf::xsputn(s + direct, count - direct);
+    }
+
+    return std::streambuf::xsputn(s, count);
+  }
+
+private:
+  direct_file m_file;
+  std::uint64_t m_written;
+  bool m_closed;
+  char *m_staging;
+  std::exception_ptr m_error;
+
+  /// Exceptions cannot propagate through std::ostream, so they are stored
+  /// and rethrown by close(). The staged data is always a whole number of
+  /// blocks when this is called.
+  bool safe_flush() {
+    if (m_error) {
+      return false;
+    }
+
+    std::size_t used = static_cast<std::size_t>(pptr() - pbase());
+    try {
+      m_file.write(pbase(), used);
+    } catch (...) {
+      m_error = std::current_exception();
+      return false;
+    }
+
+    m_written += used;
+    setp(m_staging, m_staging + STAGING_SIZE);
+    return true;
+  }
+};
+
+odirectstream::odirectstream(const std::filesystem::path &path)
+    : std::ostream(nullptr), m_buffer(new directbuf(path)) {
+  rdbuf(m_buffer.get());
+}
+
+odirectstream::~odirectstream() {
+  try {
+    m_buffer->close();
+  } catch (...) {
+  }
+}
+
+void odirectstream::close() { m_buffer->close(); }
+} // namespace npy
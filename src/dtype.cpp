@@ -1,13 +1,14 @@
+#include <algorithm>
 #include <array>
 #include <complex>
 #include <map>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
+#include "byteswap.h"
 #include "npy/npy.h"
 
-#define GETC(x) static_cast<char>((x).get())
-
 namespace {
 std::array<std::string, 13> BIG_ENDIAN_DTYPES = {
     "|i1", "|u1", ">i2", ">u2", ">i4",  ">u4", ">i8",
@@ -17,7 +18,8 @@ std::array<std::string, 13> LITTLE_ENDIAN_DTYPES = {
     "|i1", "|u1", "<i2", "<u2", "<i4",  "<u4", "<i8",
     "<u8", "<f4", "<f8", "<c8", "<c16", "|b1"};
 
-std::map<std::string, std::pair<npy::data_type_t, npy::endian_t>> DTYPE_MAP = {
+const std::map<std::string, std::pair<npy::data_type_t, npy::endian_t>>
+    DTYPE_MAP = {
     {"|u1", {npy::data_type_t::UINT8, npy::endian_t::NATIVE}},
     {"|i1", {npy::data_type_t::INT8, npy::endian_t::NATIVE}},
     {"<u2", {npy::data_type_t::UINT16, npy::endian_t::LITTLE}},
@@ -41,6 +43,50 @@ std::map<std::string, std::pair<npy::data_type_t, npy::endian_t>> DTYPE_MAP = {
     {"<c16", {npy::data_type_t::COMPLEX128, npy::endian_t::LITTLE}},
     {">c16", {npy::data_type_t::COMPLEX128, npy::endian_t::BIG}},
     {"|b1", {npy::data_type_t::BOOL, npy::endian_t::NATIVE}}};
+
+/// Non-native data is swapped in blocks of this size, so that each block is
+/// still in cache when it is swapped.
+const size_t SWAP_BLOCK_SIZE = 64 * 1024;
+
+bool is_native(npy::endian_t endianness) {
+  return endianness == npy::endian_t::NATIVE ||
+         endianness == npy::native_endian();
+}
+
+void write_words(std::ostream &output, const void *data_ptr, size_t num_words,
+                 size_t word_size, npy::endian_t endianness) {
+  const char *start = static_cast<const char *>(data_ptr);
+  size_t num_bytes = num_words * word_size;
+  if (is_native(endianness)) {
+    output.write(start, num_bytes);
+    return;
+  }
+
+  std::vector<char> buffer(std::min(num_bytes, SWAP_BLOCK_SIZE));
+  for (size_t offset = 0; offset < num_bytes; offset += buffer.size()) {
+    size_t block_size = std::min(num_bytes - offset, buffer.size());
+    npy::npy_byteswap(buffer.data(), start + offset, block_size / word_size,
+                      word_size);
+    output.write(buffer.data(), block_size);
+  }
+}
+
+void read_words(std::istream &input, void *data_ptr, size_t num_words,
+                size_t word_size, npy::endian_t endianness) {
+  char *start = static_cast<char *>(data_ptr);
+  size_t num_bytes = num_words * word_size;
+  if (is_native(endianness)) {
+    input.read(start, num_bytes);
+    return;
+  }
+
+  for (size_t offset = 0; offset < num_bytes; offset += SWAP_BLOCK_SIZE) {
+    size_t block_size = std::min(num_bytes - offset, SWAP_BLOCK_SIZE);
+    input.read(start + offset, block_size);
+    npy::npy_byteswap(start + offset, start + offset, block_size / word_size,
+                      word_size);
+  }
+}
 } // namespace
 
 namespace npy {
@@ -61,7 +107,26 @@ const std::string &to_dtype(data_type_t dtype, endian_t endianness) {
 }
 
 const std::pair<data_type_t, endian_t> &from_dtype(const std::string &dtype) {
-  return DTYPE_MAP[dtype];
+  auto it = DTYPE_MAP.find(dtype);
+  if (it == DTYPE_MAP.end()) {
+    throw std::invalid_argument("Unsupported dtype: " + dtype);
+  }
+
+  return it->second;
+}
+
+std::size_t itemsize(const std::string &dtype) {
+  if (dtype.size() < 3) {
+    throw std::invalid_argument("dtype");
+  }
+
+  std::size_t size = std::stoul(dtype.substr(2));
+  if (dtype[1] == 'U') {
+    // Unicode strings are stored as UCS-4
+    size *= 4;
+  }
+
+  return size;
 }
 
 std::ostream &operator<<(std::ostream &os, const data_type_t &value) {
@@ -117,398 +182,130 @@ template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const uint_least16_t *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 2);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 2, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, uint_least16_t *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 2);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 2) {
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 2, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const int_least16_t *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 2);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 2, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, int_least16_t *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 2);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 2) {
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 2, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const uint_least32_t *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 4);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 4, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, uint_least32_t *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 4);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 4) {
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 4, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const int_least32_t *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 4);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 4, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, int_least32_t *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 4);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 4) {
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 4, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output, const float *data_ptr,
                     size_t num_elements, endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 4);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 4, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, float *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 4);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 4) {
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 4, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const uint_least64_t *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 8);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[7]);
-      output.put(start[6]);
-      output.put(start[5]);
-      output.put(start[4]);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 8, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, uint_least64_t *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 8);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 8) {
-      ptr[7] = GETC(input);
-      ptr[6] = GETC(input);
-      ptr[5] = GETC(input);
-      ptr[4] = GETC(input);
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 8, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const int_least64_t *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 8);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[7]);
-      output.put(start[6]);
-      output.put(start[5]);
-      output.put(start[4]);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 8, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, int_least64_t *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 8);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 8) {
-      ptr[7] = GETC(input);
-      ptr[6] = GETC(input);
-      ptr[5] = GETC(input);
-      ptr[4] = GETC(input);
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 8, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output, const double *data_ptr,
                     size_t num_elements, endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 8);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[7]);
-      output.put(start[6]);
-      output.put(start[5]);
-      output.put(start[4]);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements, 8, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, double *data_ptr,
                    size_t num_elements, const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 8);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 8) {
-      ptr[7] = GETC(input);
-      ptr[6] = GETC(input);
-      ptr[5] = GETC(input);
-      ptr[4] = GETC(input);
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements, 8, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const std::complex<float> *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 8);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[7]);
-      output.put(start[6]);
-      output.put(start[5]);
-      output.put(start[4]);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements * 2, 4, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input,
                    std::complex<float> *data_ptr, size_t num_elements,
                    const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 8);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 8) {
-      ptr[7] = GETC(input);
-      ptr[6] = GETC(input);
-      ptr[5] = GETC(input);
-      ptr[4] = GETC(input);
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements * 2, 4, info.endianness);
 }
 
 template <>
 void write_values<>(std::basic_ostream<char> &output,
                     const std::complex<double> *data_ptr, size_t num_elements,
                     endian_t endianness) {
-  if (endianness == npy::endian_t::NATIVE || endianness == native_endian()) {
-    output.write(reinterpret_cast<const char *>(data_ptr), num_elements * 16);
-  } else {
-    for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
-      const char *start = reinterpret_cast<const char *>(curr);
-      output.put(start[15]);
-      output.put(start[14]);
-      output.put(start[13]);
-      output.put(start[12]);
-      output.put(start[11]);
-      output.put(start[10]);
-      output.put(start[9]);
-      output.put(start[8]);
-      output.put(start[7]);
-      output.put(start[6]);
-      output.put(start[5]);
-      output.put(start[4]);
-      output.put(start[3]);
-      output.put(start[2]);
-      output.put(start[1]);
-      output.put(start[0]);
-    }
-  }
+  write_words(output, data_ptr, num_elements * 2, 8, endianness);
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input,
                    std::complex<double> *data_ptr, size_t num_elements,
                    const header_info &info) {
-  char *start = reinterpret_cast<char *>(data_ptr);
-  if (info.endianness == npy::endian_t::NATIVE ||
-      info.endianness == native_endian()) {
-    input.read(start, num_elements * 16);
-  } else {
-    char *ptr = start;
-    for (size_t i = 0; i < num_elements; ++i, ptr += 16) {
-      ptr[15] = GETC(input);
-      ptr[14] = GETC(input);
-      ptr[13] = GETC(input);
-      ptr[12] = GETC(input);
-      ptr[11] = GETC(input);
-      ptr[10] = GETC(input);
-      ptr[9] = GETC(input);
-      ptr[8] = GETC(input);
-      ptr[7] = GETC(input);
-      ptr[6] = GETC(input);
-      ptr[5] = GETC(input);
-      ptr[4] = GETC(input);
-      ptr[3] = GETC(input);
-      ptr[2] = GETC(input);
-      ptr[1] = GETC(input);
-      ptr[0] = GETC(input);
-    }
-  }
+  read_words(input, data_ptr, num_elements * 2, 8, info.endianness);
 }
 
 template <>
@@ -522,54 +319,25 @@ void write_values<>(std::basic_ostream<char> &output,
     }
   }
 
+  std::vector<std::int_least32_t> buffer(max_element_length);
   for (auto curr = data_ptr; curr < data_ptr + num_elements; ++curr) {
+    std::fill(buffer.begin(), buffer.end(), 0);
     for (size_t i = 0; i < curr->size(); ++i) {
-      std::int_least32_t value = static_cast<std::int_least32_t>(curr->at(i));
-
-      const char *start = reinterpret_cast<const char *>(&value);
-      if (endianness == npy::endian_t::NATIVE ||
-          endianness == native_endian()) {
-        output.put(start[0]);
-        output.put(start[1]);
-        output.put(start[2]);
-        output.put(start[3]);
-      } else {
-        output.put(start[3]);
-        output.put(start[2]);
-        output.put(start[1]);
-        output.put(start[0]);
-      }
+      buffer[i] = static_cast<std::int_least32_t>(curr->at(i));
     }
 
-    for (size_t i = curr->size(); i < max_element_length; ++i) {
-      output.put(0);
-      output.put(0);
-      output.put(0);
-      output.put(0);
-    }
+    write_words(output, buffer.data(), buffer.size(), 4, endianness);
   }
 }
 
 template <>
 void read_values<>(std::basic_istream<char> &input, std::wstring *data_ptr,
                    size_t num_elements, const header_info &info) {
+  std::vector<std::int_least32_t> buffer(info.max_element_length);
   std::wstring *ptr = data_ptr;
   for (size_t i = 0; i < num_elements; ++i, ++ptr) {
-    std::int_least32_t value = 0;
-    char *bytes = reinterpret_cast<char *>(&value);
-    for (size_t j = 0; j < info.max_element_length; ++j) {
-      if (info.endianness == npy::endian_t::NATIVE ||
-          info.endianness == native_endian()) {
-        bytes[0] = GETC(input);
-        bytes[1] = GETC(input);
-        bytes[2] = GETC(input);
-        bytes[3] = GETC(input);
-      } else {
-        bytes[3] = GETC(input);
-        bytes[2] = GETC(input);
-        bytes[1] = GETC(input);
-        bytes[0] = GETC(input);
-      }
+    read_words(input, buffer.data(), buffer.size(), 4, info.endianness);
+    for (auto value : buffer) {
       if (value == 0) {
         continue;
       }
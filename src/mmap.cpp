@@ -0,0 +1,99 @@
+#include <stdexcept>
+
+#include "npy/npy.h"
+
+#if defined(_WIN32) || defined(WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace npy {
+#if defined(_WIN32) || defined(WIN32)
+memory_map::memory_map(const std::filesystem::path &path)
+    : m_data(nullptr), m_size(0) {
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::invalid_argument("path");
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw std::runtime_error("Unable to determine file size");
+  }
+
+  m_size = static_cast<std::size_t>(size.QuadPart);
+  if (m_size == 0) {
+    CloseHandle(file);
+    return;
+  }
+
+  HANDLE mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    throw std::runtime_error("Unable to map file");
+  }
+
+  // the view keeps the mapping object alive until it is unmapped
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (view == nullptr) {
+    throw std::runtime_error("Unable to map file");
+  }
+
+  m_data = static_cast<const char *>(view);
+}
+
+memory_map::~memory_map() {
+  if (m_data != nullptr) {
+    UnmapViewOfFile(m_data);
+  }
+}
+#else
+memory_map::memory_map(const std::filesystem::path &path)
+    : m_data(nullptr), m_size(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument("path");
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Unable to determine file size");
+  }
+
+  m_size = static_cast<std::size_t>(info.st_size);
+  if (m_size == 0) {
+    ::close(fd);
+    return;
+  }
+
+  // the mapping remains valid after the descriptor is closed
+  void *addr = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    throw std::runtime_error("Unable to map file");
+  }
+
+  m_data = static_cast<const char *>(addr);
+}
+
+memory_map::~memory_map() {
+  if (m_data != nullptr) {
+    ::munmap(const_cast<char *>(m_data), m_size);
+  }
+}
+#endif
+
+} // namespace npy
@@ -1,120 +1,166 @@
 #include <cctype>
+#include <charconv>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <tuple>
 
 #include "npy/npy.h"
 
 namespace {
-const int BUFFER_SIZE = 64 * 1024;
-char BUFFER[BUFFER_SIZE];
+/// Parses the Python dictionary literal of an NPY header in place, without
+/// copying it or using any shared state.
+class header_parser {
+public:
+  explicit header_parser(std::string_view text) : m_text(text), m_pos(0) {}
 
-void read(std::istream &input, char expected) {
-  char actual;
-  input.get(actual);
-  assert(actual == expected);
-}
-
-void read(std::istream &input, const std::string &expected) {
-  input.read(BUFFER, expected.length());
-  std::string actual(BUFFER, BUFFER + expected.length());
-  assert(actual == expected);
-}
+  char peek() const { return m_pos < m_text.size() ? m_text[m_pos] : '\0'; }
 
-void skip_whitespace(std::istream &input) {
-  char skip;
-  while (std::isspace(input.peek())) {
-    input.get(skip);
+  void skip_whitespace() {
+    while (m_pos < m_text.size() &&
+           std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+      m_pos += 1;
+    }
   }
-}
 
-std::string read_to(std::istream &input, char delim) {
-  if (input.peek() == delim) {
-    return "";
+  void read(char expected) {
+    if (peek() != expected) {
+      throw std::runtime_error("Invalid NPY header: expected '" +
+                               std::string(1, expected) + "'");
+    }
+
+    m_pos += 1;
   }
 
-  input.get(BUFFER, BUFFER_SIZE, delim);
-  auto length = input.gcount();
-  assert(length < BUFFER_SIZE);
+  bool read_if(std::string_view expected) {
+    if (m_text.substr(m_pos, expected.size()) != expected) {
+      return false;
+    }
 
-  return std::string(BUFFER, BUFFER + length);
-}
+    m_pos += expected.size();
+    return true;
+  }
 
-std::string read_string(std::istream &input) {
-  read(input, '\'');
-  std::string token = read_to(input, '\'');
-  read(input, '\'');
-  return token;
-}
+  std::string_view read_string() {
+    char quote = peek();
+    if (quote != '\'' && quote != '"') {
+      throw std::runtime_error("Invalid NPY header: expected a string");
+    }
 
-bool read_bool(std::istream &input) {
-  if (input.peek() == 'T') {
-    read(input, "True");
-    return true;
-  } else if (input.peek() == 'F') {
-    read(input, "False");
-    return false;
+    m_pos += 1;
+    size_t end = m_text.find(quote, m_pos);
+    if (end == std::string_view::npos) {
+      throw std::runtime_error("Invalid NPY header: unterminated string");
+    }
+
+    std::string_view token = m_text.substr(m_pos, end - m_pos);
+    m_pos = end + 1;
+    return token;
   }
 
-  throw std::runtime_error("Dictionary value is not a boolean");
-}
+  bool read_bool() {
+    if (read_if("True")) {
+      return true;
+    } else if (read_if("False")) {
+      return false;
+    }
+
+    throw std::runtime_error("Dictionary value is not a boolean");
+  }
 
-std::vector<size_t> read_shape(std::istream &input) {
-  read(input, '(');
-  std::istringstream tuple(read_to(input, ')'));
-  read(input, ')');
+  size_t read_size() {
+    size_t value = 0;
+    const char *begin = m_text.data() + m_pos;
+    const char *end = m_text.data() + m_text.size();
+    auto [ptr, error] = std::from_chars(begin, end, value);
+    if (error != std::errc()) {
+      throw std::runtime_error("Invalid NPY header: expected an integer");
+    }
 
-  std::vector<size_t> shape;
-  size_t size;
+    m_pos += ptr - begin;
+    // Python 2 wrote long integers with an L suffix
+    read_if("L");
+    return value;
+  }
 
-  while (tuple >> size) {
-    shape.push_back(size);
-    if (tuple.peek() == ',') {
-      read(tuple, ',');
-      skip_whitespace(tuple);
+  std::vector<size_t> read_shape() {
+    std::vector<size_t> shape;
+    read('(');
+    skip_whitespace();
+    while (peek() != ')') {
+      shape.push_back(read_size());
+      skip_whitespace();
+      if (peek() == ',') {
+        read(',');
+        skip_whitespace();
+      } else if (peek() != ')') {
+        throw std::runtime_error("Invalid NPY header: malformed shape");
+      }
     }
+
+    read(')');
+    return shape;
   }
 
-  return shape;
+private:
+  std::string_view m_text;
+  size_t m_pos;
+};
+
+size_t parse_size(std::string_view text) {
+  size_t value = 0;
+  auto [ptr, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || ptr != text.data() + text.size()) {
+    throw std::runtime_error("Invalid NPY header: malformed dtype");
+  }
+
+  return value;
 }
 } // namespace
 
 namespace npy {
-header_info::header_info(const std::string &dictionary) {
-  std::istringstream input(dictionary);
-  read(input, '{');
+header_info::header_info(std::string_view dictionary)
+    : dtype(data_type_t::UINT8), endianness(endian_t::NATIVE),
+      fortran_order(false), max_element_length(0) {
+  header_parser input(dictionary);
+  input.skip_whitespace();
+  input.read('{');
+  input.skip_whitespace();
   while (input.peek() != '}') {
-    skip_whitespace(input);
-    std::string key = read_string(input);
-    skip_whitespace(input);
-    read(input, ':');
-    skip_whitespace(input);
+    std::string_view key = input.read_string();
+    input.skip_whitespace();
+    input.read(':');
+    input.skip_whitespace();
     if (key == "descr") {
-      std::string dtype_code = read_string(input);
-      if (dtype_code[1] == 'U') {
+      std::string_view dtype_code = input.read_string();
+      if (dtype_code.size() > 2 && dtype_code[1] == 'U') {
         this->dtype = npy::data_type_t::UNICODE_STRING;
         endianness =
             dtype_code[0] == '>' ? npy::endian_t::BIG : npy::endian_t::LITTLE;
-        max_element_length = std::stoi(dtype_code.substr(2));
+        max_element_length = parse_size(dtype_code.substr(2));
       } else {
-        std::tie(this->dtype, endianness) = from_dtype(dtype_code);
+        std::tie(this->dtype, endianness) =
+            from_dtype(std::string(dtype_code));
         max_element_length = 0;
       }
-
     } else if (key == "fortran_order") {
-      fortran_order = read_bool(input);
+      fortran_order = input.read_bool();
     } else if (key == "shape") {
-      shape = read_shape(input);
+      shape = input.read_shape();
     } else {
-      throw std::runtime_error("Unsupported key: " + key);
+      throw std::runtime_error("Unsupported key: " + std::string(key));
     }
 
-    read(input, ',');
-    skip_whitespace(input);
+    input.skip_whitespace();
+    if (input.peek() == ',') {
+      input.read(',');
+      input.skip_whitespace();
+    } else if (input.peek() != '}') {
+      throw std::runtime_error("Invalid NPY header: expected ','");
+    }
   }
 
-  read(input, '}');
+  input.read('}');
 }
 
 header_info::header_info(data_type_t dtype, npy::endian_t endianness,
@@ -125,6 +171,131 @@ header_info::header_info(data_type_t dtype, npy::endian_t endianness,
   this->shape = shape;
 }
 
+std::size_t itemsize(const header_info &info) {
+  if (info.dtype == data_type_t::UNICODE_STRING) {
+    return 4 * info.max_element_length;
+  }
+
+  return itemsize(to_dtype(info.dtype, info.endianness));
+}
+
+namespace {
+/// The normalised range of a slice along one axis
+struct axis_range {
+  size_t start;
+  size_t count;
+  size_t step;
+};
+
+std::vector<axis_range> slice_ranges(const header_info &info,
+                                     const std::vector<slice> &slices) {
+  if (slices.size() > info.shape.size()) {
+    throw std::invalid_argument("slices");
+  }
+
+  std::vector<axis_range> ranges;
+  for (size_t axis = 0; axis < info.shape.size(); ++axis) {
+    slice s = axis < slices.size() ? slices[axis] : slice();
+    if (s.step == 0) {
+      throw std::invalid_argument("slice step cannot be zero");
+    }
+
+    size_t dim = info.shape[axis];
+    size_t start = std::min(s.start, dim);
+    size_t stop = std::min(s.stop, dim);
+    size_t count = stop > start ? (stop - start - 1) / s.step + 1 : 0;
+    ranges.push_back({start, count, s.step});
+  }
+
+  return ranges;
+}
+} // namespace
+
+std::vector<size_t> slice_shape(const header_info &info,
+                                const std::vector<slice> &slices) {
+  std::vector<size_t> shape;
+  for (auto &range : slice_ranges(info, slices)) {
+    shape.push_back(range.count);
+  }
+
+  return shape;
+}
+
+void for_each_slice_run(
+    const header_info &info, const std::vector<slice> &slices,
+    const std::function<void(std::uint64_t offset, size_t count)> &visit) {
+  std::vector<axis_range> ranges = slice_ranges(info, slices);
+  size_t ndim = ranges.size();
+  for (auto &range : ranges) {
+    if (range.count == 0) {
+      return;
+    }
+  }
+
+  // axes from slowest to fastest varying in storage
+  std::vector<size_t> order(ndim);
+  for (size_t i = 0; i < ndim; ++i) {
+    order[i] = info.fortran_order ? ndim - 1 - i : i;
+  }
+
+  std::vector<std::uint64_t> strides(ndim);
+  std::uint64_t stride = 1;
+  for (size_t i = ndim; i-- > 0;) {
+    strides[order[i]] = stride;
+    stride *= info.shape[order[i]];
+  }
+
+  // fold the fastest axes into a single contiguous run for as long as they
+  // are taken with a unit step, and each folded axis but the last is taken
+  // in its entirety
+  size_t run = 1;
+  size_t num_outer = ndim;
+  std::uint64_t base = 0;
+  while (num_outer > 0) {
+    size_t axis = order[num_outer - 1];
+    if (ranges[axis].step != 1) {
+      break;
+    }
+
+    run *= ranges[axis].count;
+    base += ranges[axis].start * strides[axis];
+    num_outer -= 1;
+    if (ranges[axis].count != info.shape[axis]) {
+      break;
+    }
+  }
+
+  // iterate over the remaining axes like an odometer
+  std::vector<size_t> index(num_outer, 0);
+  while (true) {
+    std::uint64_t offset = base;
+    for (size_t i = 0; i < num_outer; ++i) {
+      const axis_range &range = ranges[order[i]];
+      offset += (range.start + index[i] * range.step) * strides[order[i]];
+    }
+
+    visit(offset, run);
+
+    size_t i = num_outer;
+    while (i > 0) {
+      i -= 1;
+      index[i] += 1;
+      if (index[i] < ranges[order[i]].count) {
+        break;
+      }
+
+      index[i] = 0;
+      if (i == 0) {
+        return;
+      }
+    }
+
+    if (num_outer == 0) {
+      return;
+    }
+  }
+}
+
 header_info peek(const std::string &path) {
   std::ifstream input(path, std::ios::in | std::ios::binary);
   if (!input.is_open()) {
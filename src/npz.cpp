@@ -1,11 +1,22 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include "npy/npy.h"
+#include "threadpool.h"
 #include "zip.h"
 
 namespace {
@@ -14,17 +25,32 @@ using namespace npy;
 const std::array<std::uint8_t, 4> LOCAL_HEADER_SIG = {0x50, 0x4B, 0x03, 0x04};
 const std::array<std::uint8_t, 4> CD_HEADER_SIG = {0x50, 0x4B, 0x01, 0x02};
 const std::array<std::uint8_t, 4> CD_END_SIG = {0x50, 0x4B, 0x05, 0x06};
+const std::array<std::uint8_t, 4> ZIP64_CD_END_SIG = {0x50, 0x4B, 0x06, 0x06};
+const std::array<std::uint8_t, 4> ZIP64_CD_LOCATOR_SIG = {0x50, 0x4B, 0x06,
+                                                          0x07};
 
 const std::array<std::uint8_t, 4> EXTERNAL_ATTR = {0x00, 0x00, 0x80, 0x01};
 const std::array<std::uint8_t, 4> TIME = {0x00, 0x00, 0x21, 0x00};
+const std::size_t CD_HEADER_SIZE = 46;
+const std::size_t CD_NAME_LENGTH_OFFSET = 28;
 const int CD_END_SIZE = 22;
+const int CD_END_MAX_COMMENT_LENGTH = 0xFFFF;
+const int ZIP64_CD_END_SIZE = 56;
+const int ZIP64_CD_LOCATOR_SIZE = 20;
 const std::uint16_t STANDARD_VERSION =
     20; // 2.0 File is encrypted using traditional PKWARE encryption
 const std::uint16_t ZIP64_VERSION = 45; // 4.5 File uses ZIP64 format extensions
+const std::uint16_t LATEST_VERSION =
+    63; // 6.3 The latest version of the specification which can be read
 
 const std::uint16_t ZIP64_TAG = 1;
 const std::uint64_t ZIP64_LIMIT = 0x8FFFFFFF;
 const std::uint32_t ZIP64_PLACEHOLDER = 0xFFFFFFFF;
+const std::uint16_t ZIP64_COUNT_PLACEHOLDER = 0xFFFF;
+
+// peeking reads and inflates only enough of a file for a typical header,
+// and does not check the CRC32 of the file as that needs all of its data
+const std::size_t PEEK_WINDOW_SIZE = 4096;
 
 void write(std::ostream &stream, std::uint16_t value) {
   stream.put(value & 0x00FF);
@@ -38,8 +64,8 @@ void write(std::ostream &stream, std::uint32_t value) {
   }
 }
 
-void write32(std::ostream &stream, std::uint64_t value) {
-  if (value > ZIP64_LIMIT) {
+void write32(std::ostream &stream, std::uint64_t value, bool zip64) {
+  if (zip64) {
     write(stream, ZIP64_PLACEHOLDER);
   } else {
     write(stream, static_cast<std::uint32_t>(value));
@@ -53,6 +79,11 @@ void write(std::ostream &stream, std::uint64_t value) {
   }
 }
 
+std::uint16_t get16(const char *data) {
+  const std::uint8_t *bytes = reinterpret_cast<const std::uint8_t *>(data);
+  return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
 std::uint16_t read16(std::istream &stream) {
   std::uint16_t low = static_cast<std::uint16_t>(stream.get());
   std::uint16_t high = static_cast<std::uint16_t>(stream.get());
@@ -96,54 +127,48 @@ void assert_sig(std::istream &stream,
   }
 }
 
-std::uint16_t determine_extra_length(const npy::file_entry &header,
-                                     bool include_offset) {
-  std::uint16_t length = 0;
-  if (header.compressed_size > ZIP64_LIMIT) {
-    length += 8;
+/// Which of the sizes and offset of a header are stored in its ZIP64 extra
+/// field (with a placeholder in the corresponding 32-bit field).
+struct zip64_fields {
+  bool uncompressed_size;
+  bool compressed_size;
+  bool offset;
+
+  /// The fields which need to be stored as ZIP64 values for a header
+  static zip64_fields required(const npy::file_entry &header,
+                               bool include_offset) {
+    return {header.uncompressed_size > ZIP64_LIMIT,
+            header.compressed_size > ZIP64_LIMIT,
+            include_offset && header.offset > ZIP64_LIMIT};
   }
 
-  if (header.uncompressed_size > ZIP64_LIMIT) {
-    length += 8;
-  }
+  bool any() const { return uncompressed_size || compressed_size || offset; }
 
-  if (include_offset && header.offset > ZIP64_LIMIT) {
-    length += 8;
+  std::uint16_t length() const {
+    return static_cast<std::uint16_t>(
+        8 * (uncompressed_size + compressed_size + offset));
   }
-
-  return length;
-}
+};
 
 void write_zip64_extra(std::ostream &stream, const npy::file_entry &header,
-                       bool include_offset) {
-  std::vector<std::uint64_t> extra;
-  if (header.uncompressed_size > ZIP64_LIMIT) {
-    extra.push_back(header.uncompressed_size);
-  }
-
-  if (header.compressed_size > ZIP64_LIMIT) {
-    extra.push_back(header.compressed_size);
+                       const zip64_fields &fields) {
+  write(stream, ZIP64_TAG);
+  write(stream, fields.length());
+  if (fields.uncompressed_size) {
+    write(stream, header.uncompressed_size);
   }
 
-  if (include_offset && header.offset > ZIP64_LIMIT) {
-    extra.push_back(header.offset);
+  if (fields.compressed_size) {
+    write(stream, header.compressed_size);
   }
 
-  write(stream, ZIP64_TAG);
-  write(stream, static_cast<std::uint16_t>(extra.size() * 8));
-  for (auto val : extra) {
-    write(stream, val);
+  if (fields.offset) {
+    write(stream, header.offset);
   }
 }
 
 void read_zip64_extra(std::istream &stream, npy::file_entry &header,
-                      bool include_offset) {
-  std::uint16_t tag = read16(stream);
-  if (tag != ZIP64_TAG) {
-    throw std::runtime_error("Invalid tag (expected ZIP64)");
-  }
-
-  std::uint16_t actual_size = read16(stream);
+                      bool include_offset, std::uint16_t size) {
   std::uint16_t expected_size = 0;
 
   if (header.uncompressed_size == ZIP64_PLACEHOLDER) {
@@ -161,24 +186,59 @@ void read_zip64_extra(std::istream &stream, npy::file_entry &header,
     expected_size += 8;
   }
 
-  if (actual_size < expected_size) {
+  if (size < expected_size) {
     throw std::runtime_error("ZIP64 extra info missing");
   }
 
-  if (actual_size > expected_size) {
+  if (size > expected_size) {
     // this can be the result of force_zip64 being set in Python's zipfile
-    stream.seekg(actual_size - expected_size, std::ios::cur);
+    stream.seekg(size - expected_size, std::ios::cur);
+  }
+}
+
+/// Reads the extra field of a header, which may hold other records (e.g.
+/// timestamps written by other tools) besides the ZIP64 extended information.
+void read_extra(std::istream &stream, npy::file_entry &header,
+                bool include_offset, std::uint16_t length) {
+  bool found_zip64 = false;
+  std::uint32_t remaining = length;
+  while (remaining >= 4) {
+    std::uint16_t tag = read16(stream);
+    std::uint16_t size = read16(stream);
+    remaining -= 4;
+    if (size > remaining) {
+      throw std::runtime_error("Invalid extra field");
+    }
+
+    if (tag == ZIP64_TAG) {
+      read_zip64_extra(stream, header, include_offset, size);
+      found_zip64 = true;
+    } else {
+      stream.seekg(size, std::ios::cur);
+    }
+
+    remaining -= size;
+  }
+
+  stream.seekg(remaining, std::ios::cur);
+
+  bool needs_zip64 = header.uncompressed_size == ZIP64_PLACEHOLDER ||
+                     header.compressed_size == ZIP64_PLACEHOLDER ||
+                     (include_offset && header.offset == ZIP64_PLACEHOLDER);
+  if (needs_zip64 && !found_zip64) {
+    throw std::runtime_error("ZIP64 extra info missing");
   }
 }
 
-void write_shared_header(std::ostream &stream, const npy::file_entry &header) {
+void write_shared_header(std::ostream &stream, const npy::file_entry &header,
+                         const zip64_fields &fields) {
   std::uint16_t general_purpose_big_flag = 0;
   write(stream, general_purpose_big_flag);
   write(stream, header.compression_method);
   stream.write(reinterpret_cast<const char *>(TIME.data()), TIME.size());
   write(stream, header.crc32);
-  write32(stream, header.compressed_size);
-  write32(stream, header.uncompressed_size);
+  write32(stream, header.compressed_size, fields.compressed_size);
+  write32(stream, header.uncompressed_size, fields.uncompressed_size);
   write(stream, static_cast<std::uint16_t>(header.filename.length()));
 }
 
@@ -193,24 +253,89 @@ std::uint16_t read_shared_header(std::istream &stream,
   return read16(stream);
 }
 
+/// The codec for a compression method, or nullptr for STORED.
+std::shared_ptr<const codec> require_codec(compression_method_t compression) {
+  if (compression == compression_method_t::STORED) {
+    return nullptr;
+  }
+
+  std::shared_ptr<const codec> result = find_codec(compression);
+  if (!result) {
+    throw std::invalid_argument("Unsupported compression method");
+  }
+
+  return result;
+}
+
+/// The version of the ZIP specification needed to extract a file
+std::uint16_t version_needed(const npy::file_entry &header,
+                             const zip64_fields &fields) {
+  std::uint16_t version = fields.any() ? ZIP64_VERSION : STANDARD_VERSION;
+  std::shared_ptr<const codec> file_codec = find_codec(
+      static_cast<compression_method_t>(header.compression_method));
+  if (file_codec) {
+    version = std::max(version, file_codec->version_needed());
+  }
+
+  return version;
+}
+
+/// Writes a local header. As the local header is written before the data, the
+/// fields which are stored as ZIP64 values are reserved up front based upon
+/// the expected sizes, so that the header can be rewritten in place once the
+/// actual sizes and checksum are known.
 void write_local_header(std::ostream &stream, const npy::file_entry &header,
-                        bool zip64) {
+                        const zip64_fields &fields) {
   stream.write(reinterpret_cast<const char *>(LOCAL_HEADER_SIG.data()),
                LOCAL_HEADER_SIG.size());
-  write(stream, zip64 ? ZIP64_VERSION : STANDARD_VERSION);
-  write_shared_header(stream, header);
-  std::uint16_t extra_field_length = determine_extra_length(header, false);
+  write(stream, version_needed(header, fields));
+  write_shared_header(stream, header, fields);
+  std::uint16_t extra_field_length = fields.any() ? fields.length() + 4 : 0;
   write(stream, extra_field_length);
   stream.write(header.filename.data(), header.filename.length());
-  if (extra_field_length > 0) {
-    write_zip64_extra(stream, header, false);
+  if (fields.any()) {
+    write_zip64_extra(stream, header, fields);
+  }
+}
+
+/// The ZIP64 fields to reserve in the local header of a file, given the
+/// expected size of its uncompressed data. Files written in one pass and files
+/// compressed ahead of time must agree on this so that their output is the
+/// same.
+zip64_fields reserve_zip64_fields(std::uint64_t size,
+                                  const codec *file_codec) {
+  std::uint64_t max_compressed_size =
+      file_codec ? file_codec->bound(size) : size;
+  return {size > ZIP64_LIMIT, max_compressed_size > ZIP64_LIMIT, false};
+}
+
+/// Completes a file whose data has been written after a local header with
+/// placeholder values, by computing its compressed size and then rewriting the
+/// local header in place. The archive is left positioned after the data.
+void rewrite_local_header(std::ostream &archive, npy::file_entry &header,
+                          const zip64_fields &fields,
+                          std::uint64_t data_offset) {
+  std::uint64_t end = static_cast<std::uint64_t>(archive.tellp());
+  header.compressed_size = end - data_offset;
+
+  zip64_fields required = zip64_fields::required(header, false);
+  if ((required.uncompressed_size && !fields.uncompressed_size) ||
+      (required.compressed_size && !fields.compressed_size)) {
+    throw std::runtime_error("File is larger than its expected size");
+  }
+
+  archive.seekp(header.offset, std::ios::beg);
+  write_local_header(archive, header, fields);
+  archive.seekp(end, std::ios::beg);
+  if (archive.fail()) {
+    throw std::runtime_error("Error writing to archive");
   }
 }
 
 npy::file_entry read_local_header(std::istream &stream) {
   assert_sig(stream, LOCAL_HEADER_SIG, "local_header");
   std::uint16_t version = read16(stream);
-  if (version > ZIP64_VERSION) {
+  if (version > LATEST_VERSION) {
     throw std::runtime_error("Unsupported NPZ version");
   }
 
@@ -222,21 +347,20 @@ npy::file_entry read_local_header(std::istream &stream) {
   stream.read(buffer.data(), filename_length);
   entry.filename = std::string(buffer.begin(), buffer.end());
 
-  if (extra_field_length > 0) {
-    read_zip64_extra(stream, entry, false);
-  }
+  read_extra(stream, entry, false, extra_field_length);
 
   return entry;
 }
 
 void write_central_directory_header(std::ostream &stream,
                                     const npy::file_entry &header) {
-  std::uint16_t extra_field_length = determine_extra_length(header, true);
+  zip64_fields fields = zip64_fields::required(header, true);
+  std::uint16_t extra_field_length = fields.any() ? fields.length() + 4 : 0;
   stream.write(reinterpret_cast<const char *>(CD_HEADER_SIG.data()),
                CD_HEADER_SIG.size());
   write(stream, STANDARD_VERSION);
-  write(stream, extra_field_length > 0 ? ZIP64_VERSION : STANDARD_VERSION);
-  write_shared_header(stream, header);
+  write(stream, version_needed(header, fields));
+  write_shared_header(stream, header, fields);
   write(stream, extra_field_length);
   std::uint16_t file_comment_length = 0;
   write(stream, file_comment_length);
@@ -246,10 +370,10 @@ void write_central_directory_header(std::ostream &stream,
   write(stream, internal_file_attributes);
   stream.write(reinterpret_cast<const char *>(EXTERNAL_ATTR.data()),
                EXTERNAL_ATTR.size());
-  write32(stream, header.offset);
+  write32(stream, header.offset, fields.offset);
   stream.write(header.filename.data(), header.filename.length());
-  if (extra_field_length > 0) {
-    write_zip64_extra(stream, header, true);
+  if (fields.any()) {
+    write_zip64_extra(stream, header, fields);
   }
 }
 
@@ -257,7 +381,7 @@ npy::file_entry read_central_directory_header(std::istream &stream) {
   assert_sig(stream, CD_HEADER_SIG, "central_directory");
   read16(stream); // version made by
   std::uint16_t version = read16(stream);
-  if (version > ZIP64_VERSION) {
+  if (version > LATEST_VERSION) {
     throw std::runtime_error("Unsupported NPZ version");
   }
 
@@ -274,17 +398,21 @@ npy::file_entry read_central_directory_header(std::istream &stream) {
   stream.read(buffer.data(), filename_length);
   entry.filename = std::string(buffer.begin(), buffer.end());
 
-  if (extra_field_length > 0) {
-    read_zip64_extra(stream, entry, true);
-  }
+  read_extra(stream, entry, true, extra_field_length);
 
   return entry;
 }
 
 struct CentralDirectory {
-  std::uint16_t num_entries;
-  std::uint32_t size;
-  std::uint32_t offset;
+  std::uint64_t num_entries;
+  std::uint64_t size;
+  std::uint64_t offset;
+
+  /// Whether the directory needs the ZIP64 end of central directory record
+  bool zip64() const {
+    return num_entries >= ZIP64_COUNT_PLACEHOLDER || size > ZIP64_LIMIT ||
+           offset > ZIP64_LIMIT;
+  }
 };
 
 void write_end_of_central_directory(std::ostream &stream,
@@ -294,10 +422,13 @@ void write_end_of_central_directory(std::ostream &stream,
   uint16_t disk_number = 0;
   write(stream, disk_number);
   write(stream, disk_number);
-  write(stream, dir.num_entries);
-  write(stream, dir.num_entries);
-  write(stream, dir.size);
-  write(stream, dir.offset);
+  std::uint16_t num_entries =
+      dir.zip64() ? ZIP64_COUNT_PLACEHOLDER
+                  : static_cast<std::uint16_t>(dir.num_entries);
+  write(stream, num_entries);
+  write(stream, num_entries);
+  write32(stream, dir.size, dir.zip64());
+  write32(stream, dir.offset, dir.zip64());
   std::uint16_t file_comment_length = 0;
   write(stream, file_comment_length);
 }
@@ -315,104 +446,226 @@ CentralDirectory read_end_of_central_directory(std::istream &stream) {
   return result;
 }
 
-void read_entries(std::istream &input,
-                  std::map<std::string, file_entry> &entries,
-                  std::vector<std::string> &keys) {
-  input.seekg(-CD_END_SIZE, std::ios::end);
-  CentralDirectory dir = read_end_of_central_directory(input);
+void write_zip64_end_of_central_directory(std::ostream &stream,
+                                          const CentralDirectory &dir) {
+  stream.write(reinterpret_cast<const char *>(ZIP64_CD_END_SIG.data()),
+               ZIP64_CD_END_SIG.size());
+  // the size of the record excludes the signature and this field
+  write(stream, static_cast<std::uint64_t>(ZIP64_CD_END_SIZE - 12));
+  write(stream, ZIP64_VERSION);
+  write(stream, ZIP64_VERSION);
+  std::uint32_t disk_number = 0;
+  write(stream, disk_number);
+  write(stream, disk_number);
+  write(stream, dir.num_entries);
+  write(stream, dir.num_entries);
+  write(stream, dir.size);
+  write(stream, dir.offset);
+}
 
-  input.seekg(dir.offset, std::ios::beg);
+CentralDirectory read_zip64_end_of_central_directory(std::istream &stream) {
+  assert_sig(stream, ZIP64_CD_END_SIG, "zip64_end_of_central_directory");
 
-  for (size_t i = 0; i < dir.num_entries; ++i) {
-    file_entry entry = read_central_directory_header(input);
-    entries[entry.filename] = entry;
-    keys.push_back(entry.filename);
+  CentralDirectory result;
+  read64(stream); // size of the record
+  read16(stream); // version made by
+  std::uint16_t version = read16(stream);
+  if (version > ZIP64_VERSION) {
+    throw std::runtime_error("Unsupported NPZ version");
   }
 
-  std::sort(keys.begin(), keys.end());
+  read32(stream); // number of this disk
+  read32(stream); // number of the disk with the start of the central directory
+  read64(stream); // num_entries_on_disk
+  result.num_entries = read64(stream);
+  result.size = read64(stream);
+  result.offset = read64(stream);
+  return result;
 }
 
-void close(std::ostream &output, const std::vector<file_entry> &entries) {
-  CentralDirectory dir;
-  dir.offset = static_cast<std::uint32_t>(output.tellp());
-  for (auto &header : entries) {
-    write_central_directory_header(output, header);
+void write_zip64_end_of_central_directory_locator(std::ostream &stream,
+                                                  std::uint64_t offset) {
+  stream.write(reinterpret_cast<const char *>(ZIP64_CD_LOCATOR_SIG.data()),
+               ZIP64_CD_LOCATOR_SIG.size());
+  std::uint32_t disk_number = 0;
+  write(stream, disk_number);
+  write(stream, offset);
+  std::uint32_t num_disks = 1;
+  write(stream, num_disks);
+}
+
+/// Finds the end of central directory record, which is normally the last
+/// thing in the archive but can be followed by a comment.
+std::uint64_t find_end_of_central_directory(std::istream &input) {
+  input.seekg(0, std::ios::end);
+  std::uint64_t length = static_cast<std::uint64_t>(input.tellg());
+  if (length < CD_END_SIZE) {
+    throw std::runtime_error("Invalid signature (Not a valid NPZ file)");
   }
 
-  dir.size = static_cast<std::uint32_t>(output.tellp()) - dir.offset;
-  dir.num_entries = static_cast<std::uint16_t>(entries.size());
-  write_end_of_central_directory(output, dir);
+  std::uint64_t tail_length = std::min<std::uint64_t>(
+      length, CD_END_SIZE + CD_END_MAX_COMMENT_LENGTH);
+  std::vector<char> tail(tail_length);
+  input.seekg(length - tail_length, std::ios::beg);
+  input.read(tail.data(), tail.size());
+  for (std::uint64_t i = tail_length - CD_END_SIZE + 1; i-- > 0;) {
+    if (std::equal(CD_END_SIG.begin(), CD_END_SIG.end(),
+                   reinterpret_cast<const std::uint8_t *>(tail.data() + i))) {
+      return length - tail_length + i;
+    }
+  }
+
+  // no signature: fall back to the standard location to report the error
+  return length - CD_END_SIZE;
 }
 
-void write_file(std::ostream &output, std::vector<file_entry> &entries,
-                const std::string &filename,
-                compression_method_t compression_method, std::string &&bytes) {
-  std::uint32_t uncompressed_size = static_cast<std::uint32_t>(bytes.size());
-  std::uint32_t compressed_size = 0;
-  std::string compressed_bytes;
-  std::uint32_t checksum = npy_crc32(bytes);
-  if (compression_method == compression_method_t::STORED) {
-    compressed_bytes = bytes;
-    compressed_size = uncompressed_size;
-  } else if (compression_method == compression_method_t::DEFLATED) {
-    compressed_bytes = npy_deflate(std::move(bytes));
-    compressed_size = static_cast<std::uint32_t>(compressed_bytes.size());
-  } else {
-    throw std::invalid_argument("Unsupported compression method");
+CentralDirectory read_central_directory(std::istream &input) {
+  std::uint64_t end_offset = find_end_of_central_directory(input);
+  input.seekg(end_offset, std::ios::beg);
+  CentralDirectory dir = read_end_of_central_directory(input);
+
+  if (end_offset >= ZIP64_CD_LOCATOR_SIZE) {
+    input.seekg(end_offset - ZIP64_CD_LOCATOR_SIZE, std::ios::beg);
+    std::array<std::uint8_t, 4> sig;
+    input.read(reinterpret_cast<char *>(sig.data()), sig.size());
+    if (sig == ZIP64_CD_LOCATOR_SIG) {
+      read32(input); // disk with the ZIP64 record
+      std::uint64_t offset = read64(input);
+      input.seekg(offset, std::ios::beg);
+      dir = read_zip64_end_of_central_directory(input);
+    }
   }
 
-  file_entry entry = {filename,
-                      checksum,
-                      compressed_size,
-                      uncompressed_size,
-                      static_cast<std::uint16_t>(compression_method),
-                      static_cast<std::uint32_t>(output.tellp())};
+  return dir;
+}
+
+/// Reads the bytes of the central directory in one go.
+std::string read_directory(std::istream &input, std::uint64_t &num_entries) {
+  CentralDirectory dir = read_central_directory(input);
+  input.seekg(0, std::ios::end);
+  std::uint64_t length = static_cast<std::uint64_t>(input.tellg());
+  if (dir.offset > length || dir.size > length - dir.offset) {
+    throw std::runtime_error("Central directory is truncated");
+  }
+
+  std::string directory(static_cast<std::size_t>(dir.size), '\0');
+  input.seekg(dir.offset, std::ios::beg);
+  if (!input.read(directory.data(), directory.size())) {
+    throw std::runtime_error("Error reading central directory");
+  }
 
-  bool zip64 = uncompressed_size > ZIP64_LIMIT || compressed_size > ZIP64_LIMIT;
-  write_local_header(output, entry, zip64);
-  output.write(compressed_bytes.data(), compressed_size);
-  entries.push_back(std::move(entry));
+  num_entries = dir.num_entries;
+  return directory;
 }
 
-typedef union crcbytes_u {
-  std::uint32_t value;
-  std::uint8_t bytes[4];
-} CRCBytes;
+/// Visits the name and position of each header in the bytes of a central
+/// directory, without decoding the rest of the header.
+template <typename F>
+void for_each_directory_header(const std::string &directory,
+                               std::uint64_t num_entries, F visit) {
+  std::size_t position = 0;
+  for (std::uint64_t i = 0; i < num_entries; ++i) {
+    const char *header = directory.data() + position;
+    if (directory.size() - position < CD_HEADER_SIZE ||
+        !std::equal(CD_HEADER_SIG.begin(), CD_HEADER_SIG.end(),
+                    reinterpret_cast<const std::uint8_t *>(header))) {
+      throw std::runtime_error("Invalid signature (Not a valid NPZ file)");
+    }
 
-std::string read_file(std::istream &input,
-                      const std::map<std::string, file_entry> &entries,
-                      const std::string &temp_filename) {
-  std::string filename = temp_filename;
-  if (entries.count(filename) == 0) {
-    filename += ".npy";
-    if (entries.count(filename) == 0) {
-      throw std::invalid_argument("filename");
+    std::size_t name_length = get16(header + CD_NAME_LENGTH_OFFSET);
+    std::size_t length = CD_HEADER_SIZE + name_length +
+                         get16(header + CD_NAME_LENGTH_OFFSET + 2) +
+                         get16(header + CD_NAME_LENGTH_OFFSET + 4);
+    if (directory.size() - position < length) {
+      throw std::runtime_error("Central directory is truncated");
     }
+
+    visit(std::string_view(header + CD_HEADER_SIZE, name_length), position);
+    position += length;
   }
+}
 
-  const file_entry &entry = entries.at(filename);
-  input.seekg(entry.offset, std::ios::beg);
+/// Stream buffer over bytes which are already in memory.
+class viewbuf : public std::streambuf {
+public:
+  viewbuf(const char *data, std::size_t size) {
+    char *begin = const_cast<char *>(data);
+    setg(begin, begin, begin + size);
+  }
 
-  file_entry local = read_local_header(input);
-  if (!entry.check(local)) {
-    throw std::runtime_error("Central directory and local headers disagree");
+protected:
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                   std::ios_base::openmode) override {
+    char *base = dir == std::ios_base::beg   ? eback()
+                 : dir == std::ios_base::cur ? gptr()
+                                             : egptr();
+    if (offset < eback() - base || offset > egptr() - base) {
+      return pos_type(off_type(-1));
+    }
+
+    setg(eback(), base + offset, egptr());
+    return pos_type(gptr() - eback());
+  }
+
+  pos_type seekpos(pos_type position, std::ios_base::openmode which) override {
+    return seekoff(off_type(position), std::ios_base::beg, which);
+  }
+};
+
+/// Reads the central directory, returning the entries in the order in which
+/// they appear and the offset of the start of the directory.
+std::vector<file_entry> read_entries(std::istream &input,
+                                     std::uint64_t &directory_offset) {
+  CentralDirectory dir = read_central_directory(input);
+
+  input.seekg(dir.offset, std::ios::beg);
+
+  std::vector<file_entry> entries;
+  for (std::uint64_t i = 0; i < dir.num_entries; ++i) {
+    entries.push_back(read_central_directory_header(input));
+  }
+
+  directory_offset = dir.offset;
+  return entries;
+}
+
+void close(std::ostream &output, const std::vector<file_entry> &entries) {
+  // a file which has been written more than once is replaced by its last
+  // copy, the data of the earlier ones being left in place unreferenced
+  std::map<std::string, std::size_t> latest;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    latest[entries[i].filename] = i;
+  }
+
+  CentralDirectory dir;
+  dir.offset = static_cast<std::uint64_t>(output.tellp());
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    if (latest[entries[i].filename] == i) {
+      write_central_directory_header(output, entries[i]);
+    }
   }
 
-  std::string uncompressed_bytes;
-  uncompressed_bytes.resize(entry.compressed_size);
-  input.read(reinterpret_cast<char *>(uncompressed_bytes.data()),
-             uncompressed_bytes.size());
-  compression_method_t cmethod =
-      static_cast<compression_method_t>(entry.compression_method);
-  if (cmethod == compression_method_t::DEFLATED) {
-    uncompressed_bytes = npy_inflate(std::move(uncompressed_bytes));
+  dir.size = static_cast<std::uint64_t>(output.tellp()) - dir.offset;
+  dir.num_entries = latest.size();
+  if (dir.zip64()) {
+    std::uint64_t zip64_offset = static_cast<std::uint64_t>(output.tellp());
+    write_zip64_end_of_central_directory(output, dir);
+    write_zip64_end_of_central_directory_locator(output, zip64_offset);
   }
 
-  std::uint32_t actual_crc32 = npy_crc32(uncompressed_bytes);
+  write_end_of_central_directory(output, dir);
+}
+
+typedef union crcbytes_u {
+  std::uint32_t value;
+  std::uint8_t bytes[4];
+} CRCBytes;
+
+void check_crc32(const file_entry &entry, std::uint32_t actual_crc32) {
   if (actual_crc32 != entry.crc32) {
     CRCBytes actual_bytes{actual_crc32};
     CRCBytes expected_bytes{entry.crc32};
-    printf("CRC mismatch when reading %s:\n", filename.c_str());
+    printf("CRC mismatch when reading %s:\n", entry.filename.c_str());
     printf("actual: [0x%x, 0x%x, 0x%x, 0x%x]\n", actual_bytes.bytes[0],
            actual_bytes.bytes[1], actual_bytes.bytes[2], actual_bytes.bytes[3]);
     printf("expected: [0x%x, 0x%x, 0x%x, 0x%x]\n", expected_bytes.bytes[0],
@@ -420,13 +673,597 @@ std::string read_file(std::istream &input,
            expected_bytes.bytes[3]);
     throw std::runtime_error("CRC mismatch");
   }
+}
+
+const file_entry &seek_file(std::istream &input, const file_index &entries,
+                            const std::string &filename) {
+  const file_entry *found = entries.find_npy(filename);
+  if (found == nullptr) {
+    throw std::invalid_argument("filename");
+  }
+
+  const file_entry &entry = *found;
+  input.seekg(entry.offset, std::ios::beg);
+
+  file_entry local = read_local_header(input);
+  if (!entry.check(local)) {
+    throw std::runtime_error("Central directory and local headers disagree");
+  }
+
+  return entry;
+}
+
+/// Whether the values of a tensor fit in the given number of bytes. This is
+/// checked one dimension at a time, as the product of the dimensions can
+/// overflow.
+bool values_fit(const header_info &info, std::uint64_t size) {
+  if (std::find(info.shape.begin(), info.shape.end(), 0) != info.shape.end()) {
+    return true;
+  }
+
+  std::uint64_t available = size / std::max<std::size_t>(itemsize(info), 1);
+  std::uint64_t count = 1;
+  for (auto &dim : info.shape) {
+    if (dim > available / count) {
+      return false;
+    }
+
+    count *= dim;
+  }
 
-  return uncompressed_bytes;
+  return true;
 }
 
 } // namespace
 
 namespace npy {
+/// Stream buffer which produces the (uncompressed) data of a single file in
+/// an archive, reading it from the archive stream on demand.
+class imemberbuf : public std::streambuf {
+public:
+  imemberbuf(std::istream &archive, const file_entry &entry,
+             std::size_t window_size)
+      : m_archive(archive), m_entry(entry), m_remaining(entry.compressed_size),
+        m_produced(0), m_crc32(0), m_input_size(0), m_input_next(nullptr),
+        m_window(window_size) {
+    m_codec = require_codec(
+        static_cast<compression_method_t>(entry.compression_method));
+    // a small window means only the start of the file is wanted, so the
+    // file is only decompressed in one call if it will be read whole
+    bool one_shot = m_codec && (m_codec->flags() & codec::ONE_SHOT) &&
+                    window_size >= imemberstream::WINDOW_SIZE;
+    if (m_codec && (m_codec->flags() & codec::STREAMING) && !one_shot) {
+      m_decompressor = m_codec->decompressor();
+      m_input.resize(window_size);
+    }
+  }
+
+  void verify() {
+    if (m_error) {
+      std::rethrow_exception(m_error);
+    }
+
+    setg(nullptr, nullptr, nullptr);
+    while (produce(m_window.data(), m_window.size()) > 0) {
+    }
+
+    if (m_produced != m_entry.uncompressed_size) {
+      throw std::runtime_error("File data is truncated");
+    }
+
+    check_crc32(m_entry, m_crc32);
+  }
+
+protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    std::size_t size = safe_produce(m_window.data(), m_window.size());
+    if (size == 0) {
+      return traits_type::eof();
+    }
+
+    setg(m_window.data(), m_window.data(), m_window.data() + size);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  std::streamsize xsgetn(char *s, std::streamsize count) override {
+    std::size_t total = 0;
+    std::size_t n = static_cast<std::size_t>(count);
+    while (total < n) {
+      std::size_t buffered = static_cast<std::size_t>(egptr() - gptr());
+      if (buffered > 0) {
+        std::size_t size = std::min(buffered, n - total);
+        std::copy(gptr(), gptr() + size, s + total);
+        gbump(static_cast<int>(size));
+        total += size;
+      } else if (n - total >= m_window.size()) {
+        // large reads bypass the window and go straight to the destination
+        std::size_t size = safe_produce(s + total, n - total);
+        if (size == 0) {
+          break;
+        }
+
+        total += size;
+      } else if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+        break;
+      }
+    }
+
+    return static_cast<std::streamsize>(total);
+  }
+
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                   std::ios_base::openmode) override {
+    // the data can only be read in order, so the position can be queried
+    // but not changed
+    if (offset != 0 || dir != std::ios_base::cur) {
+      return pos_type(off_type(-1));
+    }
+
+    return pos_type(static_cast<off_type>(m_produced) - (egptr() - gptr()));
+  }
+
+private:
+  std::istream &m_archive;
+  file_entry m_entry;
+  std::uint64_t m_remaining;
+  std::uint64_t m_produced;
+  std::uint32_t m_crc32;
+  std::shared_ptr<const codec> m_codec;
+  std::unique_ptr<codec_decompressor> m_decompressor;
+  /// The whole of the data, for codecs which cannot decompress incrementally
+  /// (or which are faster in one call)
+  std::string m_decompressed;
+  std::vector<char> m_input;
+  std::size_t m_input_size;
+  const char *m_input_next;
+  std::vector<char> m_window;
+  std::exception_ptr m_error;
+
+  /// Exceptions cannot propagate through std::istream, so they are stored
+  /// and rethrown by verify().
+  std::size_t safe_produce(char *output, std::size_t size) {
+    if (m_error) {
+      return 0;
+    }
+
+    try {
+      return produce(output, size);
+    } catch (...) {
+      m_error = std::current_exception();
+      return 0;
+    }
+  }
+
+  std::size_t produce(char *output, std::size_t size) {
+    std::uint64_t limit = m_entry.uncompressed_size - m_produced;
+    size = static_cast<std::size_t>(std::min<std::uint64_t>(size, limit));
+    std::size_t produced = 0;
+    if (m_decompressor) {
+      // some streams (e.g. a series of frames) do not mark their end, and so
+      // end with the uncompressed data
+      while (produced < size && !m_decompressor->finished()) {
+        refill();
+        produced += m_decompressor->decompress(
+            m_input_next, m_input_size, output + produced, size - produced);
+      }
+    } else if (m_codec) {
+      if (size > 0 && m_decompressed.empty()) {
+        decompress_all();
+      }
+
+      std::copy(m_decompressed.data() + m_produced,
+                m_decompressed.data() + m_produced + size, output);
+      produced = size;
+    } else if (size > 0) {
+      if (!m_archive.read(output, size)) {
+        throw std::runtime_error("Error reading from archive");
+      }
+
+      produced = size;
+    }
+
+    m_crc32 = npy_crc32(m_crc32, output, produced);
+    m_produced += produced;
+    return produced;
+  }
+
+  /// Reads and decompresses all of the data at once.
+  void decompress_all() {
+    std::string bytes(static_cast<std::size_t>(m_remaining), '\0');
+    if (!m_archive.read(bytes.data(), bytes.size())) {
+      throw std::runtime_error("Error reading from archive");
+    }
+
+    m_remaining = 0;
+    m_decompressed =
+        m_codec->decompress(std::move(bytes), m_entry.uncompressed_size);
+    if (m_decompressed.size() != m_entry.uncompressed_size) {
+      throw std::runtime_error("File data is truncated");
+    }
+  }
+
+  /// Reads the next window of compressed data, if the last has been used.
+  void refill() {
+    if (m_input_size > 0) {
+      return;
+    }
+
+    if (m_remaining == 0) {
+      throw std::runtime_error("Compressed data is truncated");
+    }
+
+    m_input_size = static_cast<std::size_t>(
+        std::min<std::uint64_t>(m_input.size(), m_remaining));
+    if (!m_archive.read(m_input.data(), m_input_size)) {
+      throw std::runtime_error("Error reading from archive");
+    }
+
+    m_remaining -= m_input_size;
+    m_input_next = m_input.data();
+  }
+};
+
+imemberstream::imemberstream(std::istream &archive, const file_entry &entry,
+                             std::size_t window_size)
+    : std::istream(nullptr),
+      m_buffer(new imemberbuf(archive, entry, window_size)) {
+  rdbuf(m_buffer.get());
+}
+
+imemberstream::~imemberstream() = default;
+
+void imemberstream::verify() { m_buffer->verify(); }
+
+/// Stream buffer which writes the data of a single file to an archive,
+/// compressing it and accumulating its checksum as it is produced.
+class omemberbuf : public std::streambuf {
+public:
+  omemberbuf(std::ostream &archive, const std::string &filename,
+             compression_method_t compression, std::uint64_t size, int level)
+      : m_archive(archive), m_level(level), m_crc32(0), m_consumed(0),
+        m_window(WINDOW_SIZE) {
+    m_codec = require_codec(compression);
+    if (m_codec && (m_codec->flags() & codec::STREAMING) &&
+        !(m_codec->flags() & codec::ONE_SHOT)) {
+      m_compressor = m_codec->compressor(archive, level);
+    } else if (m_codec) {
+      m_buffered.reserve(static_cast<std::size_t>(size));
+    }
+
+    m_entry = {filename,
+               0,
+               0,
+               0,
+               static_cast<std::uint16_t>(compression),
+               static_cast<std::uint64_t>(archive.tellp())};
+    m_fields = reserve_zip64_fields(size, m_codec.get());
+    write_local_header(archive, m_entry, m_fields);
+    m_data_offset = static_cast<std::uint64_t>(archive.tellp());
+    setp(m_window.data(), m_window.data() + m_window.size());
+  }
+
+  file_entry close() {
+    if (m_error) {
+      std::rethrow_exception(m_error);
+    }
+
+    consume(pbase(), static_cast<std::size_t>(pptr() - pbase()));
+    setp(nullptr, nullptr);
+    if (m_compressor) {
+      m_compressor->finish();
+    } else if (m_codec) {
+      std::string bytes =
+          m_codec->compress(m_buffered.data(), m_buffered.size(), m_level);
+      if (!m_archive.write(bytes.data(), bytes.size())) {
+        throw std::runtime_error("Error writing to archive");
+      }
+    }
+
+    m_entry.crc32 = m_crc32;
+    m_entry.uncompressed_size = m_consumed;
+    rewrite_local_header(m_archive, m_entry, m_fields, m_data_offset);
+    return m_entry;
+  }
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (!safe_consume(pbase(), static_cast<std::size_t>(pptr() - pbase()))) {
+      return traits_type::eof();
+    }
+
+    setp(m_window.data(), m_window.data() + m_window.size());
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize count) override {
+    std::size_t n = static_cast<std::size_t>(count);
+    if (n >= m_window.size()) {
+      // large writes bypass the window and go straight to the archive
+      if (!safe_consume(pbase(), static_cast<std::size_t>(pptr() - pbase()))) {
+        return 0;
+      }
+
+      setp(m_window.data(), m_window.data() + m_window.size());
+      return safe_consume(s, n) ? count : 0;
+    }
+
+    std::size_t total = 0;
+    while (total < n) {
+      std::size_t space = static_cast<std::size_t>(epptr() - pptr());
+      if (space == 0) {
+        if (traits_type::eq_int_type(overflow(traits_type::eof()),
+                                     traits_type::eof())) {
+          break;
+        }
+
+        continue;
+      }
+
+      std::size_t size = std::min(space, n - total);
+      std::copy(s + total, s + total + size, pptr());
+      pbump(static_cast<int>(size));
+      total += size;
+    }
+
+    return static_cast<std::streamsize>(total);
+  }
+
+private:
+  static const std::size_t WINDOW_SIZE = 64 * 1024;
+
+  std::ostream &m_archive;
+  file_entry m_entry;
+  zip64_fields m_fields;
+  std::uint64_t m_data_offset;
+  int m_level;
+  std::uint32_t m_crc32;
+  std::uint64_t m_consumed;
+  std::shared_ptr<const codec> m_codec;
+  std::unique_ptr<codec_compressor> m_compressor;
+  /// The whole of the data, for codecs which cannot compress incrementally
+  /// (or which are faster in one call)
+  std::string m_buffered;
+  std::vector<char> m_window;
+  std::exception_ptr m_error;
+
+  /// Exceptions cannot propagate through std::ostream, so they are stored
+  /// and rethrown by close().
+  bool safe_consume(const char *data, std::size_t size) {
+    if (m_error) {
+      return false;
+    }
+
+    try {
+      consume(data, size);
+      return true;
+    } catch (...) {
+      m_error = std::current_exception();
+      return false;
+    }
+  }
+
+  void consume(const char *data, std::size_t size) {
+    if (size == 0) {
+      return;
+    }
+
+    m_crc32 = npy_crc32(m_crc32, data, size);
+    m_consumed += size;
+    if (m_compressor) {
+      m_compressor->write(data, size);
+    } else if (m_codec) {
+      m_buffered.append(data, size);
+    } else if (!m_archive.write(data, size)) {
+      throw std::runtime_error("Error writing to archive");
+    }
+  }
+};
+
+omemberstream::omemberstream(std::ostream &archive, const std::string &filename,
+                             compression_method_t compression,
+                             std::uint64_t size, int level)
+    : std::ostream(nullptr),
+      m_buffer(new omemberbuf(archive, filename, compression, size, level)) {
+  rdbuf(m_buffer.get());
+}
+
+omemberstream::~omemberstream() = default;
+
+file_entry omemberstream::close() { return m_buffer->close(); }
+
+/// Stream buffer which appends everything written to it to a string.
+class obytebuf : public std::streambuf {
+public:
+  explicit obytebuf(std::size_t capacity) { m_bytes.reserve(capacity); }
+
+  std::string release() {
+    std::string bytes = std::move(m_bytes);
+    m_bytes.clear();
+    return bytes;
+  }
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      m_bytes.push_back(traits_type::to_char_type(ch));
+    }
+
+    return traits_type::not_eof(ch);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize count) override {
+    m_bytes.append(s, static_cast<std::size_t>(count));
+    return count;
+  }
+
+private:
+  std::string m_bytes;
+};
+
+obytestream::obytestream(std::size_t capacity)
+    : std::ostream(nullptr), m_buffer(new obytebuf(capacity)) {
+  rdbuf(m_buffer.get());
+}
+
+obytestream::~obytestream() = default;
+
+std::string obytestream::release() { return m_buffer->release(); }
+
+/// Queue of files which are compressed on a pool of worker threads, and then
+/// written to the archive in the order in which they were queued. Files larger
+/// than the block size (if set) are split into blocks which are compressed and
+/// checksummed independently, so that a single large file can also make use
+/// of all the workers, if their codec supports it.
+class compression_queue {
+public:
+  compression_queue(std::size_t num_threads, std::size_t block_size)
+      : m_pool(num_threads), m_block_size(block_size),
+        m_num_pending_blocks(0) {}
+
+  void push(std::ostream &archive, std::vector<file_entry> &entries,
+            const std::string &filename, std::string &&bytes,
+            compression_method_t compression, int level) {
+    std::shared_ptr<const codec> file_codec = require_codec(compression);
+    auto data = std::make_shared<std::string>(std::move(bytes));
+    std::size_t block_size = data->size();
+    if (m_block_size > 0 && data->size() > m_block_size &&
+        (!file_codec || (file_codec->flags() & codec::BLOCKS))) {
+      block_size = m_block_size;
+    }
+
+    pending_file file;
+    file.entry = {filename,
+                  0,
+                  0,
+                  data->size(),
+                  static_cast<std::uint16_t>(compression),
+                  0};
+    file.file_codec = file_codec;
+    m_pending.push_back(std::move(file));
+
+    std::size_t offset = 0;
+    do {
+      std::size_t size = std::min(block_size, data->size() - offset);
+      bool last = offset + size == data->size();
+      bool whole = offset == 0 && last;
+      m_pending.back().blocks.push_back(
+          m_pool.submit([data, offset, size, last, whole, file_codec,
+                         level]() {
+            return compress(data->data() + offset, size, last, whole,
+                            file_codec.get(), level);
+          }));
+      m_pending.back().submitted = last;
+      ++m_num_pending_blocks;
+      offset += size;
+
+      // blocks are written as soon as they (and those before them) are
+      // done, and the number waiting is bounded so that the memory held by
+      // compressed blocks does not grow with the size of the file
+      write_ready(archive, entries);
+      while (m_num_pending_blocks > 2 * m_pool.size()) {
+        write_next(archive, entries);
+      }
+    } while (offset < data->size());
+  }
+
+  void flush(std::ostream &archive, std::vector<file_entry> &entries) {
+    while (!m_pending.empty()) {
+      write_next(archive, entries);
+    }
+  }
+
+private:
+  struct compressed_block {
+    std::uint32_t crc32;
+    std::uint64_t size;
+    std::string bytes;
+  };
+
+  struct pending_file {
+    /// the entry, whose sizes and checksum are filled in as blocks are
+    /// written
+    file_entry entry;
+    std::shared_ptr<const codec> file_codec;
+    std::deque<std::future<compressed_block>> blocks;
+    /// whether the last block has been submitted
+    bool submitted = false;
+    /// whether the local header has been written
+    bool started = false;
+    zip64_fields fields = {false, false, false};
+    std::uint64_t data_offset = 0;
+  };
+
+  thread_pool m_pool;
+  std::size_t m_block_size;
+  std::deque<pending_file> m_pending;
+  std::size_t m_num_pending_blocks;
+
+  static compressed_block compress(const char *data, std::size_t size,
+                                   bool last, bool whole,
+                                   const codec *file_codec, int level) {
+    compressed_block block;
+    block.crc32 = npy_crc32(0, data, size);
+    block.size = size;
+    if (!file_codec) {
+      block.bytes = std::string(data, size);
+    } else if (whole) {
+      block.bytes = file_codec->compress(data, size, level);
+    } else {
+      block.bytes = file_codec->compress_block(data, size, last, level);
+    }
+
+    return block;
+  }
+
+  /// Writes every block which is ready, in order, without waiting.
+  void write_ready(std::ostream &archive, std::vector<file_entry> &entries) {
+    while (!m_pending.empty() && !m_pending.front().blocks.empty() &&
+           m_pending.front().blocks.front().wait_for(
+               std::chrono::seconds(0)) == std::future_status::ready) {
+      write_next(archive, entries);
+    }
+  }
+
+  /// Writes the next block, waiting for it if needed, and completes its
+  /// file if it was the last.
+  void write_next(std::ostream &archive, std::vector<file_entry> &entries) {
+    pending_file &file = m_pending.front();
+    if (!file.started) {
+      file.entry.offset = static_cast<std::uint64_t>(archive.tellp());
+      file.fields =
+          reserve_zip64_fields(file.entry.uncompressed_size,
+                               file.file_codec.get());
+      write_local_header(archive, file.entry, file.fields);
+      file.data_offset = static_cast<std::uint64_t>(archive.tellp());
+      file.started = true;
+    }
+
+    compressed_block block = file.blocks.front().get();
+    file.blocks.pop_front();
+    --m_num_pending_blocks;
+    file.entry.crc32 =
+        npy_crc32_combine(file.entry.crc32, block.crc32, block.size);
+    if (!archive.write(block.bytes.data(), block.bytes.size())) {
+      throw std::runtime_error("Error writing to archive");
+    }
+
+    if (file.submitted && file.blocks.empty()) {
+      rewrite_local_header(archive, file.entry, file.fields, file.data_offset);
+      entries.push_back(std::move(file.entry));
+      m_pending.pop_front();
+    }
+  }
+};
+
 bool file_entry::check(const file_entry &other) const {
   return !(other.filename != this->filename || other.crc32 != this->crc32 ||
            other.compression_method != this->compression_method ||
@@ -434,76 +1271,253 @@ bool file_entry::check(const file_entry &other) const {
            other.uncompressed_size != this->uncompressed_size);
 }
 
+file_index::file_index(std::string &&directory, std::uint64_t num_entries,
+                       bool lazy)
+    : m_directory(std::move(directory)), m_num_entries(num_entries),
+      m_used(!lazy) {
+  if (!lazy) {
+    index();
+    m_entries.reserve(m_names.size());
+    viewbuf buffer(m_directory.data(), m_directory.size());
+    std::istream input(&buffer);
+    for_each_directory_header(
+        m_directory, m_num_entries, [&](std::string_view, size_t position) {
+          input.seekg(position, std::ios::beg);
+          m_entries[position] = read_central_directory_header(input);
+        });
+  }
+}
+
+void file_index::index() const {
+  std::call_once(m_index_flag, [this]() {
+    const std::string_view suffix = ".npy";
+    // the count comes from the file, so is only trusted as far as the
+    // directory could hold that many headers
+    size_t capacity = static_cast<size_t>(std::min<std::uint64_t>(
+        m_num_entries, m_directory.size() / CD_HEADER_SIZE));
+    m_names.reserve(capacity);
+    m_stems.reserve(capacity);
+    for_each_directory_header(
+        m_directory, m_num_entries, [this, &suffix](std::string_view name,
+                                                    size_t position) {
+          // if a name appears more than once, its last entry is used
+          m_names[name] = position;
+          if (name.size() >= suffix.size() &&
+              name.substr(name.size() - suffix.size()) == suffix) {
+            m_stems[name.substr(0, name.size() - suffix.size())] = position;
+          }
+        });
+  });
+}
+
+size_t file_index::locate(std::string_view filename, bool npy) const {
+  const std::string_view suffix = ".npy";
+  if (!m_used.load(std::memory_order_relaxed) && !m_used.exchange(true)) {
+    // a single lookup is answered by a scan, which is quicker than building
+    // the tables. Every name is checked, as the last match is the one used.
+    size_t exact = std::string::npos;
+    size_t stem = std::string::npos;
+    for_each_directory_header(
+        m_directory, m_num_entries,
+        [&](std::string_view name, size_t position) {
+          if (name == filename) {
+            exact = position;
+          } else if (npy && name.size() == filename.size() + suffix.size() &&
+                     name.substr(0, filename.size()) == filename &&
+                     name.substr(filename.size()) == suffix) {
+            stem = position;
+          }
+        });
+
+    return exact != std::string::npos ? exact : stem;
+  }
+
+  index();
+  auto it = m_names.find(filename);
+  if (it != m_names.end()) {
+    return it->second;
+  }
+
+  if (npy) {
+    it = m_stems.find(filename);
+    if (it != m_stems.end()) {
+      return it->second;
+    }
+  }
+
+  return std::string::npos;
+}
+
+const file_entry *file_index::entry(size_t position) const {
+  std::lock_guard<std::mutex> lock(m_entries_mutex);
+  auto it = m_entries.find(position);
+  if (it == m_entries.end()) {
+    viewbuf buffer(m_directory.data() + position,
+                   m_directory.size() - position);
+    std::istream input(&buffer);
+    it = m_entries.emplace(position, read_central_directory_header(input))
+             .first;
+  }
+
+  return &it->second;
+}
+
+bool file_index::contains(std::string_view filename) const {
+  return locate(filename, false) != std::string::npos;
+}
+
+const file_entry *file_index::find(std::string_view filename) const {
+  size_t position = locate(filename, false);
+  return position == std::string::npos ? nullptr : entry(position);
+}
+
+const file_entry *file_index::find_npy(std::string_view filename) const {
+  size_t position = locate(filename, true);
+  return position == std::string::npos ? nullptr : entry(position);
+}
+
+const std::vector<std::string> &file_index::keys() const {
+  std::call_once(m_keys_flag, [this]() {
+    index();
+    m_keys.reserve(m_names.size());
+    for (auto &name : m_names) {
+      m_keys.emplace_back(name.first);
+    }
+
+    std::sort(m_keys.begin(), m_keys.end());
+  });
+
+  return m_keys;
+}
+
 npzstringwriter::npzstringwriter(compression_method_t compression,
-                                 endian_t endianness)
+                                 endian_t endianness, std::size_t num_threads,
+                                 std::size_t block_size)
     : m_closed(false), m_compression_method(compression),
-      m_endianness(endianness) {}
+      m_compression_level(0), m_endianness(endianness) {
+  require_codec(compression);
+  if (num_threads > 0) {
+    m_queue.reset(new compression_queue(num_threads, block_size));
+  }
+}
 
 npzstringwriter::~npzstringwriter() {
-  if (!m_closed) {
+  // a destructor must not throw, so errors are only reported by an explicit
+  // call to close
+  try {
     close();
+  } catch (...) {
   }
 }
 
 std::string npzstringwriter::str() const { return m_output.str(); }
 
-void npzstringwriter::write_file(const std::string &filename,
-                                 std::string &&bytes) {
-  if (m_closed) {
-    throw std::runtime_error("NPZ file has been closed");
-  }
+void npzstringwriter::set_compression_level(int level) {
+  m_compression_level = level;
+}
 
-  ::write_file(m_output, m_entries, filename, m_compression_method,
-               std::move(bytes));
+void npzstringwriter::write_file(const std::string &filename,
+                                 std::string &&bytes,
+                                 compression_method_t compression) {
+  m_queue->push(m_output, m_entries, filename, std::move(bytes), compression,
+                m_compression_level);
 }
 
 void npzstringwriter::close() {
   if (!m_closed) {
-    ::close(m_output, m_entries);
+    // a failed close is not retried
     m_closed = true;
+    if (m_queue) {
+      m_queue->flush(m_output, m_entries);
+    }
+
+    ::close(m_output, m_entries);
   }
 }
 
 npzfilewriter::npzfilewriter(const std::string &path,
                              compression_method_t compression,
-                             endian_t endianness)
-    : m_closed(false), m_output(path, std::ios::binary),
-      m_compression_method(compression), m_endianness(endianness) {}
+                             endian_t endianness, std::size_t num_threads,
+                             std::size_t block_size, bool append)
+    : npzfilewriter(std::filesystem::path(path), compression, endianness,
+                    num_threads, block_size, append) {}
+
+npzfilewriter::npzfilewriter(const char *path, compression_method_t compression,
+                             endian_t endianness, std::size_t num_threads,
+                             std::size_t block_size, bool append)
+    : npzfilewriter(std::filesystem::path(path), compression, endianness,
+                    num_threads, block_size, append) {}
 
 npzfilewriter::npzfilewriter(const std::filesystem::path &path,
                              compression_method_t compression,
-                             endian_t endianness)
-    : m_closed(false), m_output(path, std::ios::binary),
-      m_compression_method(compression), m_endianness(endianness) {}
+                             endian_t endianness, std::size_t num_threads,
+                             std::size_t block_size, bool append)
+    : m_closed(false), m_compression_method(compression),
+      m_compression_level(0), m_endianness(endianness) {
+  require_codec(compression);
+  if (append && std::filesystem::exists(path)) {
+    std::uint64_t directory_offset;
+    {
+      std::ifstream input(path, std::ios::binary);
+      if (!input.is_open()) {
+        throw std::invalid_argument("path");
+      }
+
+      m_entries = ::read_entries(input, directory_offset);
+    }
 
-npzfilewriter::npzfilewriter(const char *path, compression_method_t compression,
-                             endian_t endianness)
-    : m_closed(false), m_output(path, std::ios::binary),
-      m_compression_method(compression), m_endianness(endianness) {}
+    // the new files overwrite the old central directory, and a new one
+    // (listing the old files and the new) is written after them on close
+    m_output.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    m_output.seekp(directory_offset, std::ios::beg);
+    m_path = path;
+  } else {
+    m_output.open(path, std::ios::binary);
+  }
+
+  if (num_threads > 0) {
+    m_queue.reset(new compression_queue(num_threads, block_size));
+  }
+}
 
 npzfilewriter::~npzfilewriter() {
-  if (!m_closed) {
+  // a destructor must not throw, so errors are only reported by an explicit
+  // call to close
+  try {
     close();
+  } catch (...) {
   }
 }
 
 bool npzfilewriter::is_open() const { return m_output.is_open(); }
 
-void npzfilewriter::write_file(const std::string &filename,
-                               std::string &&bytes) {
-  if (m_closed) {
-    throw std::runtime_error("NPZ file has been closed");
-  }
+void npzfilewriter::set_compression_level(int level) {
+  m_compression_level = level;
+}
 
-  ::write_file(m_output, m_entries, filename, m_compression_method,
-               std::move(bytes));
+void npzfilewriter::write_file(const std::string &filename,
+                               std::string &&bytes,
+                               compression_method_t compression) {
+  m_queue->push(m_output, m_entries, filename, std::move(bytes), compression,
+                m_compression_level);
 }
 
 void npzfilewriter::close() {
   if (!m_closed) {
-    ::close(m_output, m_entries);
+    // a failed close is not retried
     m_closed = true;
+    if (m_queue) {
+      m_queue->flush(m_output, m_entries);
+    }
+
+    ::close(m_output, m_entries);
+    std::uint64_t size = static_cast<std::uint64_t>(m_output.tellp());
     m_output.close();
+    if (!m_path.empty()) {
+      // the new directory can be shorter than the old one if files have
+      // been replaced, so anything left beyond it is removed
+      std::filesystem::resize_file(m_path, size);
+    }
   }
 }
 
@@ -517,64 +1531,179 @@ npzstringreader::npzstringreader(std::string &&bytes)
 }
 
 void npzstringreader::read_entries() {
-  ::read_entries(m_input, m_entries, m_keys);
+  std::uint64_t num_entries;
+  std::string directory = read_directory(m_input, num_entries);
+  m_entries.reset(new file_index(std::move(directory), num_entries));
 }
 
-const std::vector<std::string> &npzstringreader::keys() const { return m_keys; }
+const std::vector<std::string> &npzstringreader::keys() const {
+  return m_entries->keys();
+}
 
-std::string npzstringreader::read_file(const std::string &filename) {
-  return ::read_file(m_input, m_entries, filename);
+const file_entry &npzstringreader::seek_file(const std::string &filename) {
+  return ::seek_file(m_input, *m_entries, filename);
 }
 
 bool npzstringreader::contains(const std::string &filename) {
-  return m_entries.count(filename);
+  return m_entries->contains(filename);
 }
 
 header_info npzstringreader::peek(const std::string &filename) {
-  std::istringstream stream(read_file(filename));
-  return npy::peek(stream);
+  imemberstream stream(m_input, seek_file(filename), PEEK_WINDOW_SIZE);
+  return read_npy_header(stream);
 }
 
-npzfilereader::npzfilereader(const std::string &path)
-    : m_input(path, std::ios::binary) {
-  read_entries();
+npzfilereader::npzfilereader(const std::string &path, bool lazy)
+    : m_path(path) {
+  read_entries(lazy);
 }
 
-npzfilereader::npzfilereader(const char *path)
-    : m_input(path, std::ios::binary) {
-  read_entries();
+npzfilereader::npzfilereader(const char *path, bool lazy)
+    : m_path(path) {
+  read_entries(lazy);
 }
 
-npzfilereader::npzfilereader(const std::filesystem::path &path)
-    : m_input(path, std::ios::binary) {
-  read_entries();
+npzfilereader::npzfilereader(const std::filesystem::path &path, bool lazy)
+    : m_path(path) {
+  read_entries(lazy);
 }
 
-void npzfilereader::read_entries() {
-  if (!m_input.is_open()) {
+void npzfilereader::read_entries(bool lazy) {
+  if (!std::filesystem::is_regular_file(m_path)) {
     throw std::invalid_argument("File not found");
   }
 
-  ::read_entries(m_input, m_entries, m_keys);
+  auto file = std::make_shared<const pread_file>(m_path);
+  {
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    m_file = file;
+  }
+
+  ipreadstream input(file);
+  std::uint64_t num_entries;
+  std::string directory = read_directory(input, num_entries);
+  m_entries.reset(new file_index(std::move(directory), num_entries, lazy));
+}
+
+const std::vector<std::string> &npzfilereader::keys() const {
+  return m_entries->keys();
+}
+
+std::shared_ptr<const pread_file> npzfilereader::file() const {
+  std::lock_guard<std::mutex> lock(m_file_mutex);
+  if (!m_file) {
+    throw std::runtime_error("NPZ file is closed");
+  }
+
+  return m_file;
+}
+
+const file_entry &npzfilereader::seek_file(std::istream &input,
+                                           const std::string &filename) const {
+  return ::seek_file(input, *m_entries, filename);
+}
+
+void npzfilereader::seek_stored_file(std::istream &input,
+                                     const std::string &filename) const {
+  const file_entry &entry = seek_file(input, filename);
+  if (entry.compression_method !=
+      static_cast<std::uint16_t>(compression_method_t::STORED)) {
+    throw std::runtime_error("File is compressed (not STORED)");
+  }
+
+  // the values are read straight from the archive, so a header which claims
+  // more of them than the file holds would read into whatever follows it
+  std::streampos start = input.tellg();
+  header_info info = read_npy_header(input);
+  std::uint64_t header_size = static_cast<std::uint64_t>(input.tellg() - start);
+  if (header_size > entry.uncompressed_size ||
+      !values_fit(info, entry.uncompressed_size - header_size)) {
+    throw std::out_of_range("Tensor extends past the end of its file");
+  }
+
+  input.seekg(start);
+}
+
+header_info npzfilereader::seek_data(std::istream &input,
+                                     const std::string &filename) const {
+  seek_stored_file(input, filename);
+  return read_npy_header(input);
 }
 
-const std::vector<std::string> &npzfilereader::keys() const { return m_keys; }
+std::uint64_t npzfilereader::data_offset(const std::string &filename) {
+  ipreadstream input(file());
+  seek_data(input, filename);
+  return static_cast<std::uint64_t>(input.tellg());
+}
+
+std::shared_ptr<const memory_map> npzfilereader::archive_map() {
+  std::lock_guard<std::mutex> lock(m_map_mutex);
+  if (!m_map) {
+    m_map = std::make_shared<const memory_map>(m_path);
+  }
 
-std::string npzfilereader::read_file(const std::string &filename) {
-  return ::read_file(m_input, m_entries, filename);
+  return m_map;
 }
 
 bool npzfilereader::contains(const std::string &filename) {
-  return m_entries.count(filename);
+  return m_entries->contains(filename);
 }
 
 header_info npzfilereader::peek(const std::string &filename) {
-  std::istringstream stream(read_file(filename));
-  return npy::peek(stream);
+  ipreadstream input(file(), PEEK_WINDOW_SIZE);
+  imemberstream stream(input, seek_file(input, filename), PEEK_WINDOW_SIZE);
+  return read_npy_header(stream);
 }
 
-bool npzfilereader::is_open() const { return m_input.is_open(); }
+std::vector<member_info> npzfilereader::manifest(std::size_t num_threads) {
+  auto describe = [this](const std::string &filename) {
+    ipreadstream input(file(), PEEK_WINDOW_SIZE);
+    const file_entry &entry = seek_file(input, filename);
+    std::uint64_t data_offset = static_cast<std::uint64_t>(input.tellg());
+    imemberstream stream(input, entry, PEEK_WINDOW_SIZE);
+    header_info header = read_npy_header(stream);
+    std::uint64_t header_size = static_cast<std::uint64_t>(stream.tellg());
+    return member_info{entry, data_offset, header_size, header};
+  };
+
+  std::vector<member_info> manifest;
+  if (num_threads == 0) {
+    for (const auto &filename : keys()) {
+      manifest.push_back(describe(filename));
+    }
+
+    return manifest;
+  }
 
-void npzfilereader::close() { m_input.close(); }
+  // the pool runs any remaining tasks before it is destroyed, even if one of
+  // them throws
+  thread_pool pool(num_threads);
+  std::vector<std::future<member_info>> pending;
+  for (const auto &filename : keys()) {
+    pending.push_back(
+        pool.submit([&describe, &filename]() { return describe(filename); }));
+  }
+
+  for (auto &task : pending) {
+    manifest.push_back(task.get());
+  }
+
+  return manifest;
+}
+
+bool npzfilereader::is_open() const {
+  std::lock_guard<std::mutex> lock(m_file_mutex);
+  return m_file != nullptr;
+}
+
+void npzfilereader::close() {
+  {
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    m_file.reset();
+  }
+
+  std::lock_guard<std::mutex> lock(m_map_mutex);
+  m_map.reset();
+}
 
-} // namespace npy
\ No newline at end of file
+} // namespace npy
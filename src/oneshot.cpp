@@ -0,0 +1,84 @@
+#include "oneshot.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include <libdeflate.h>
+
+namespace {
+const int DEFAULT_LEVEL = 6;
+const int MAX_LEVEL = 12;
+
+using compressor_ptr = std::unique_ptr<libdeflate_compressor,
+                                       decltype(&libdeflate_free_compressor)>;
+using decompressor_ptr =
+    std::unique_ptr<libdeflate_decompressor,
+                    decltype(&libdeflate_free_decompressor)>;
+
+/// Compressors are costly to allocate next to compressing a small member, so
+/// each thread keeps one for every level it has used.
+libdeflate_compressor *thread_compressor(int level) {
+  thread_local std::map<int, compressor_ptr> compressors;
+  auto it = compressors.find(level);
+  if (it == compressors.end()) {
+    compressor_ptr compressor(libdeflate_alloc_compressor(level),
+                              libdeflate_free_compressor);
+    if (!compressor) {
+      throw std::runtime_error("Unable to initialize deflate algorithm");
+    }
+
+    it = compressors.emplace(level, std::move(compressor)).first;
+  }
+
+  return it->second.get();
+}
+
+/// Decompressors have no settings, so each thread keeps just one.
+libdeflate_decompressor *thread_decompressor() {
+  thread_local decompressor_ptr decompressor(libdeflate_alloc_decompressor(),
+                                             libdeflate_free_decompressor);
+  if (!decompressor) {
+    throw std::runtime_error("Unable to initialize inflate algorithm");
+  }
+
+  return decompressor.get();
+}
+} // namespace
+
+namespace npy {
+std::string npy_oneshot_deflate(const char *data, std::size_t size,
+                                int level) {
+  level = level > 0 ? std::min(level, MAX_LEVEL) : DEFAULT_LEVEL;
+  libdeflate_compressor *compressor = thread_compressor(level);
+  std::string output(libdeflate_deflate_compress_bound(compressor, size),
+                     '\0');
+  std::size_t compressed_size = libdeflate_deflate_compress(
+      compressor, data, size, output.data(), output.size());
+  if (compressed_size == 0) {
+    throw std::runtime_error("Error deflating stream");
+  }
+
+  output.resize(compressed_size);
+  return output;
+}
+
+std::string npy_oneshot_inflate(const std::string &bytes, std::uint64_t size) {
+  std::string output(static_cast<std::size_t>(size), '\0');
+  // without an actual size to return, anything other than exactly filling
+  // the output is an error
+  libdeflate_result result = libdeflate_deflate_decompress(
+      thread_decompressor(), bytes.data(), bytes.size(), output.data(),
+      output.size(), nullptr);
+  if (result == LIBDEFLATE_SHORT_OUTPUT) {
+    throw std::runtime_error("Compressed data is truncated");
+  }
+
+  if (result != LIBDEFLATE_SUCCESS) {
+    throw std::runtime_error("Error inflating stream");
+  }
+
+  return output;
+}
+} // namespace npy
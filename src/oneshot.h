@@ -0,0 +1,36 @@
+// ----------------------------------------------------------------------------
+//
+// oneshot.h -- whole-buffer DEFLATE of NPZ members through libdeflate
+//
+// Copyright (C) 2021 Matthew Johnson
+//
+// For conditions of distribution and use, see copyright notice in LICENSE
+//
+// ----------------------------------------------------------------------------
+
+#ifndef _ONESHOT_H_
+#define _ONESHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace npy {
+/** Deflate a block of bytes in a single call.
+ *  \param data pointer to the bytes
+ *  \param size the number of bytes
+ *  \param level the compression level, from 1 to 12 (0 for the default)
+ *  \return the compressed bytes, as a complete raw DEFLATE stream
+ */
+std::string npy_oneshot_deflate(const char *data, std::size_t size, int level);
+
+/** Inflate a raw DEFLATE stream in a single call, straight into a buffer of
+ *  its decompressed size.
+ *  \param bytes the compressed bytes
+ *  \param size the size of the decompressed data
+ *  \return the decompressed bytes
+ */
+std::string npy_oneshot_inflate(const std::string &bytes, std::uint64_t size);
+} // namespace npy
+
+#endif
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "npy/npy.h"
+
+#if defined(_WIN32) || defined(WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pread.h"
+#ifdef LIBNPY_USE_IO_URING
+#include "uring.h"
+#endif
+#endif
+
+namespace npy {
+#if defined(_WIN32) || defined(WIN32)
+pread_file::pread_file(const std::filesystem::path &path) {
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::invalid_argument("path");
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw std::runtime_error("Unable to determine file size");
+  }
+
+  m_handle = reinterpret_cast<std::intptr_t>(file);
+  m_size = static_cast<std::uint64_t>(size.QuadPart);
+}
+
+pread_file::~pread_file() { CloseHandle(reinterpret_cast<HANDLE>(m_handle)); }
+
+std::size_t pread_file::read(std::uint64_t offset, char *buffer,
+                             std::size_t size) const {
+  std::size_t total = 0;
+  while (total < size && offset < m_size) {
+    // an explicit offset makes ReadFile independent of the file pointer
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD step = static_cast<DWORD>(
+        std::min<std::size_t>(size - total, 0x40000000));
+    DWORD actual = 0;
+    if (!ReadFile(reinterpret_cast<HANDLE>(m_handle), buffer + total, step,
+                  &actual, &overlapped)) {
+      if (GetLastError() == ERROR_HANDLE_EOF) {
+        break;
+      }
+
+      throw std::runtime_error("Error reading from file");
+    }
+
+    if (actual == 0) {
+      break;
+    }
+
+    total += actual;
+    offset += actual;
+  }
+
+  return total;
+}
+#else
+pread_file::pread_file(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument("path");
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Unable to determine file size");
+  }
+
+  m_handle = fd;
+  m_size = static_cast<std::uint64_t>(info.st_size);
+}
+
+pread_file::~pread_file() { ::close(static_cast<int>(m_handle)); }
+
+std::size_t pread_all(int fd, std::uint64_t offset, char *buffer,
+                      std::size_t size) {
+  std::size_t total = 0;
+  while (total < size) {
+    ssize_t actual =
+        ::pread(fd, buffer + total, size - total, static_cast<off_t>(offset));
+    if (actual < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw std::runtime_error("Error reading from file");
+    }
+
+    if (actual == 0) {
+      break;
+    }
+
+    total += static_cast<std::size_t>(actual);
+    offset += static_cast<std::uint64_t>(actual);
+  }
+
+  return total;
+}
+
+std::size_t pread_file::read(std::uint64_t offset, char *buffer,
+                             std::size_t size) const {
+  int fd = static_cast<int>(m_handle);
+#ifdef LIBNPY_USE_IO_URING
+  if (size >= uring_reader::MIN_READ_SIZE) {
+    uring_reader *reader = uring_reader::local();
+    if (reader != nullptr) {
+      return reader->read(fd, offset, buffer, size);
+    }
+  }
+#endif
+
+  return pread_all(fd, offset, buffer, size);
+}
+#endif
+
+/// Stream buffer which reads a pread_file through a window of its own, so
+/// that each stream has an independent position in the file.
+class preadbuf : public std::streambuf {
+public:
+  preadbuf(std::shared_ptr<const pread_file> file, std::size_t window_size)
+      : m_file(std::move(file)), m_offset(0), m_window(window_size) {}
+
+protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    std::size_t size = m_file->read(m_offset, m_window.data(), m_window.size());
+    if (size == 0) {
+      return traits_type::eof();
+    }
+
+    m_offset += size;
+    setg(m_window.data(), m_window.data(), m_window.data() + size);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  std::streamsize xsgetn(char *s, std::streamsize count) override {
+    std::size_t n = static_cast<std::size_t>(count);
+    std::size_t buffered = static_cast<std::size_t>(egptr() - gptr());
+    std::size_t total = std::min(buffered, n);
+    std::copy(gptr(), gptr() + total, s);
+    gbump(static_cast<int>(total));
+    if (total == n) {
+      return count;
+    }
+
+    if (n - total >= m_window.size()) {
+      // large reads bypass the window and go straight to the destination
+      std::size_t size = m_file->read(m_offset, s + total, n - total);
+      m_offset += size;
+      // the window no longer ends at m_offset, so it cannot be reused
+      setg(nullptr, nullptr, nullptr);
+      return static_cast<std::streamsize>(total + size);
+    }
+
+    while (total < n &&
+           !traits_type::eq_int_type(underflow(), traits_type::eof())) {
+      std::size_t size = std::min(static_cast<std::size_t>(egptr() - gptr()),
+                                  n - total);
+      std::copy(gptr(), gptr() + size, s + total);
+      gbump(static_cast<int>(size));
+      total += size;
+    }
+
+    return static_cast<std::streamsize>(total);
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    std::uint64_t position = m_offset - (egptr() - gptr());
+    if (dir == std::ios_base::beg) {
+      return seekpos(pos_type(off), which);
+    } else if (dir == std::ios_base::cur) {
+      return seekpos(pos_type(static_cast<off_type>(position) + off), which);
+    }
+
+    return seekpos(pos_type(static_cast<off_type>(m_file->size()) + off),
+                   which);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::in) || off_type(pos) < 0) {
+      return pos_type(off_type(-1));
+    }
+
+    std::uint64_t position = static_cast<std::uint64_t>(off_type(pos));
+    std::uint64_t start = m_offset - (egptr() - eback());
+    if (eback() != nullptr && position >= start && position <= m_offset) {
+      // the position is within the window
+      setg(eback(), eback() + (position - start), egptr());
+    } else {
+      setg(nullptr, nullptr, nullptr);
+      m_offset = position;
+    }
+
+    return pos;
+  }
+
+private:
+  std::shared_ptr<const pread_file> m_file;
+  std::uint64_t m_offset;
+  std::vector<char> m_window;
+};
+
+ipreadstream::ipreadstream(std::shared_ptr<const pread_file> file,
+                           std::size_t window_size)
+    : std::istream(nullptr),
+      m_buffer(new preadbuf(std::move(file), window_size)) {
+  rdbuf(m_buffer.get());
+}
+
+ipreadstream::~ipreadstream() = default;
+} // namespace npy
@@ -0,0 +1,30 @@
+// ----------------------------------------------------------------------------
+//
+// pread.h -- positional reads of POSIX files
+//
+// Copyright (C) 2021 Matthew Johnson
+//
+// For conditions of distribution and use, see copyright notice in LICENSE
+//
+// ----------------------------------------------------------------------------
+
+#ifndef _PREAD_H_
+#define _PREAD_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace npy {
+/** Reads from a file at an explicit offset with pread, retrying until the
+ *  read is complete or the end of the file is reached.
+ *  \param fd the file descriptor
+ *  \param offset the offset in the file of the first byte to read
+ *  \param buffer the destination buffer
+ *  \param size the number of bytes to read
+ *  \return the number of bytes read
+ */
+std::size_t pread_all(int fd, std::uint64_t offset, char *buffer,
+                      std::size_t size);
+} // namespace npy
+
+#endif
@@ -2,59 +2,59 @@
 #include <complex>
 
 namespace npy {
-template <> data_type_t tensor<std::int8_t>::get_dtype() {
+template <> data_type_t dtype_of<std::int8_t>() {
   return data_type_t::INT8;
 };
 
-template <> data_type_t tensor<std::uint8_t>::get_dtype() {
+template <> data_type_t dtype_of<std::uint8_t>() {
   return data_type_t::UINT8;
 };
 
-template <> data_type_t tensor<std::int16_t>::get_dtype() {
+template <> data_type_t dtype_of<std::int16_t>() {
   return data_type_t::INT16;
 };
 
-template <> data_type_t tensor<std::uint16_t>::get_dtype() {
+template <> data_type_t dtype_of<std::uint16_t>() {
   return data_type_t::UINT16;
 };
 
-template <> data_type_t tensor<std::int32_t>::get_dtype() {
+template <> data_type_t dtype_of<std::int32_t>() {
   return data_type_t::INT32;
 };
 
-template <> data_type_t tensor<std::uint32_t>::get_dtype() {
+template <> data_type_t dtype_of<std::uint32_t>() {
   return data_type_t::UINT32;
 };
 
-template <> data_type_t tensor<std::int64_t>::get_dtype() {
+template <> data_type_t dtype_of<std::int64_t>() {
   return data_type_t::INT64;
 };
 
-template <> data_type_t tensor<std::uint64_t>::get_dtype() {
+template <> data_type_t dtype_of<std::uint64_t>() {
   return data_type_t::UINT64;
 };
 
-template <> data_type_t tensor<float>::get_dtype() {
+template <> data_type_t dtype_of<float>() {
   return data_type_t::FLOAT32;
 };
 
-template <> data_type_t tensor<double>::get_dtype() {
+template <> data_type_t dtype_of<double>() {
   return data_type_t::FLOAT64;
 };
 
-template <> data_type_t tensor<std::complex<float>>::get_dtype() {
+template <> data_type_t dtype_of<std::complex<float>>() {
   return data_type_t::COMPLEX64;
 }
 
-template <> data_type_t tensor<std::complex<double>>::get_dtype() {
+template <> data_type_t dtype_of<std::complex<double>>() {
   return data_type_t::COMPLEX128;
 }
 
-template <> data_type_t tensor<std::wstring>::get_dtype() {
+template <> data_type_t dtype_of<std::wstring>() {
   return data_type_t::UNICODE_STRING;
 }
 
-template <> data_type_t tensor<boolean>::get_dtype() {
+template <> data_type_t dtype_of<boolean>() {
   return data_type_t::BOOL;
 }
 
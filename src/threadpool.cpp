@@ -0,0 +1,70 @@
+#include "threadpool.h"
+#include "npy/npy.h"
+
+namespace npy {
+thread_pool::thread_pool(std::size_t num_threads) : m_stopping(false) {
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+
+  m_workers.reserve(num_threads);
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    m_workers.emplace_back(&thread_pool::run, this);
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+
+  m_ready.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void thread_pool::enqueue(std::function<void()> &&task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+
+  m_ready.notify_one();
+}
+
+void thread_pool::run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_ready.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+      if (m_tasks.empty()) {
+        return;
+      }
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+
+    task();
+  }
+}
+
+io_pool::io_pool(std::size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+
+  m_pool = std::make_unique<thread_pool>(num_threads);
+}
+
+io_pool::~io_pool() = default;
+
+std::size_t io_pool::size() const { return m_pool->size(); }
+
+void io_pool::submit(std::function<void()> task) {
+  m_pool->submit(std::move(task));
+}
+} // namespace npy
@@ -0,0 +1,74 @@
+// ----------------------------------------------------------------------------
+//
+// threadpool.h -- fixed-size pool of worker threads
+//
+// Copyright (C) 2021 Matthew Johnson
+//
+// For conditions of distribution and use, see copyright notice in LICENSE
+//
+// ----------------------------------------------------------------------------
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace npy {
+/** A fixed number of worker threads which run tasks in the order in which
+ *  they are submitted.
+ */
+class thread_pool {
+public:
+  /** Constructor.
+   *  \param num_threads the number of worker threads (at least one)
+   */
+  explicit thread_pool(std::size_t num_threads);
+
+  /** Destructor. Runs any tasks which are still queued, then joins the
+   *  workers.
+   */
+  ~thread_pool();
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  /** The number of worker threads. */
+  std::size_t size() const { return m_workers.size(); }
+
+  /** Submit a task to the pool.
+   *  \param task the task to run on a worker thread
+   *  \return a future which holds the result of the task, or the exception
+   *          which it threw
+   */
+  template <typename F>
+  std::future<typename std::invoke_result<F>::type> submit(F &&task) {
+    typedef typename std::invoke_result<F>::type result_t;
+    auto packaged = std::make_shared<std::packaged_task<result_t()>>(
+        std::forward<F>(task));
+    std::future<result_t> result = packaged->get_future();
+    enqueue([packaged]() { (*packaged)(); });
+    return result;
+  }
+
+private:
+  void enqueue(std::function<void()> &&task);
+  void run();
+
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_ready;
+  bool m_stopping;
+};
+} // namespace npy
+
+#endif
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "pread.h"
+#include "uring.h"
+
+namespace {
+const unsigned QUEUE_DEPTH = 64;
+const std::size_t CHUNK_SIZE = 512 * 1024;
+
+int io_uring_setup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+/** The number of calls to io_uring_enter which succeed before the injected
+ *  failures, and the number of failures, on this thread. */
+thread_local unsigned enter_successes = 0;
+thread_local unsigned enter_failures = 0;
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  int result = static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+                                          min_complete, flags, nullptr, 0));
+  if (enter_successes > 0) {
+    enter_successes -= 1;
+  } else if (enter_failures > 0) {
+    enter_failures -= 1;
+    errno = EIO;
+    return -1;
+  }
+
+  return result;
+}
+
+unsigned *ring_field(void *ring, std::uint32_t offset) {
+  return reinterpret_cast<unsigned *>(static_cast<char *>(ring) + offset);
+}
+
+unsigned load_acquire(const unsigned *value) {
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *value, unsigned update) {
+  __atomic_store_n(value, update, __ATOMIC_RELEASE);
+}
+} // namespace
+
+namespace npy {
+/** One read of up to CHUNK_SIZE bytes of a larger request. */
+struct uring_reader::chunk {
+  std::uint64_t offset;
+  char *buffer;
+  std::size_t size;
+  std::size_t done;
+};
+
+uring_reader *uring_reader::local() {
+  thread_local std::unique_ptr<uring_reader> reader(new uring_reader());
+  return reader->m_valid ? reader.get() : nullptr;
+}
+
+void uring_reader::fail_enter(unsigned after, unsigned count) {
+  enter_successes = after;
+  enter_failures = count;
+}
+
+uring_reader::uring_reader()
+    : m_fd(-1), m_valid(false), m_sq_ring(MAP_FAILED), m_sq_ring_size(0),
+      m_cq_ring(MAP_FAILED), m_cq_ring_size(0), m_sqes(MAP_FAILED),
+      m_sqes_size(0), m_depth(0) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  m_fd = io_uring_setup(QUEUE_DEPTH, &params);
+  if (m_fd < 0) {
+    return;
+  }
+
+  m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    m_sq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    m_cq_ring_size = 0;
+  }
+
+  m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+  if (m_sq_ring == MAP_FAILED) {
+    return;
+  }
+
+  if (m_cq_ring_size == 0) {
+    m_cq_ring = m_sq_ring;
+  } else {
+    m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED) {
+      return;
+    }
+  }
+
+  m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  m_sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+  if (m_sqes == MAP_FAILED) {
+    return;
+  }
+
+  m_sq_head = ring_field(m_sq_ring, params.sq_off.head);
+  m_sq_tail = ring_field(m_sq_ring, params.sq_off.tail);
+  m_sq_mask = ring_field(m_sq_ring, params.sq_off.ring_mask);
+  m_sq_array = ring_field(m_sq_ring, params.sq_off.array);
+  m_cq_head = ring_field(m_cq_ring, params.cq_off.head);
+  m_cq_tail = ring_field(m_cq_ring, params.cq_off.tail);
+  m_cq_mask = ring_field(m_cq_ring, params.cq_off.ring_mask);
+  m_cqes = static_cast<char *>(m_cq_ring) + params.cq_off.cqes;
+  m_depth = params.sq_entries;
+  m_valid = true;
+}
+
+uring_reader::~uring_reader() {
+  if (m_sqes != MAP_FAILED) {
+    ::munmap(m_sqes, m_sqes_size);
+  }
+
+  if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) {
+    ::munmap(m_cq_ring, m_cq_ring_size);
+  }
+
+  if (m_sq_ring != MAP_FAILED) {
+    ::munmap(m_sq_ring, m_sq_ring_size);
+  }
+
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void uring_reader::submit(int fd, chunk &c, std::uint64_t index) {
+  // only this thread produces entries, so the tail needs no synchronisation
+  // beyond publishing the new entry to the kernel
+  unsigned tail = *m_sq_tail;
+  unsigned slot = tail & *m_sq_mask;
+  io_uring_sqe *sqe = static_cast<io_uring_sqe *>(m_sqes) + slot;
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<std::uint64_t>(c.buffer + c.done);
+  sqe->len = static_cast<std::uint32_t>(c.size - c.done);
+  sqe->off = c.offset + c.done;
+  sqe->user_data = index;
+  m_sq_array[slot] = slot;
+  store_release(m_sq_tail, tail + 1);
+}
+
+bool uring_reader::enter(unsigned to_submit, unsigned min_complete) {
+  while (true) {
+    int result = io_uring_enter(m_fd, to_submit, min_complete,
+                                IORING_ENTER_GETEVENTS);
+    if (result >= 0) {
+      to_submit -= std::min(to_submit, static_cast<unsigned>(result));
+      if (to_submit == 0) {
+        return true;
+      }
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      return false;
+    }
+  }
+}
+
+std::size_t uring_reader::reap(std::vector<chunk> &chunks) {
+  std::size_t count = 0;
+  unsigned head = *m_cq_head;
+  unsigned tail = load_acquire(m_cq_tail);
+  for (; head != tail; ++head) {
+    const io_uring_cqe *cqe =
+        static_cast<const io_uring_cqe *>(m_cqes) + (head & *m_cq_mask);
+    chunk &c = chunks[static_cast<std::size_t>(cqe->user_data)];
+    if (cqe->res > 0) {
+      c.done += static_cast<std::size_t>(cqe->res);
+    }
+
+    count += 1;
+  }
+
+  store_release(m_cq_head, head);
+  return count;
+}
+
+void uring_reader::recover(std::vector<chunk> &chunks, std::size_t in_flight) {
+  // without SQPOLL the kernel only consumes entries inside io_uring_enter,
+  // so any it has not consumed can be withdrawn
+  unsigned head = load_acquire(m_sq_head);
+  in_flight -= *m_sq_tail - head;
+  store_release(m_sq_tail, head);
+
+  // the rest may still be reading into the caller's buffer, and their
+  // completions refer to these chunks, so they must be reaped before the
+  // ring is used again
+  while (in_flight > 0) {
+    if (!enter(0, static_cast<unsigned>(in_flight))) {
+      // the ring cannot be trusted, so later reads go through pread
+      m_valid = false;
+      return;
+    }
+
+    in_flight -= reap(chunks);
+  }
+}
+
+std::size_t uring_reader::read(int fd, std::uint64_t offset, char *buffer,
+                               std::size_t size) {
+  std::vector<chunk> chunks;
+  for (std::size_t start = 0; start < size; start += CHUNK_SIZE) {
+    chunks.push_back({offset + start, buffer + start,
+                      std::min(CHUNK_SIZE, size - start), 0});
+  }
+
+  std::size_t next = 0;
+  std::size_t in_flight = 0;
+  while (next < chunks.size() || in_flight > 0) {
+    unsigned to_submit = 0;
+    while (next < chunks.size() && in_flight < m_depth) {
+      submit(fd, chunks[next], next);
+      next += 1;
+      in_flight += 1;
+      to_submit += 1;
+    }
+
+    if (!enter(to_submit, 1)) {
+      recover(chunks, in_flight);
+      break;
+    }
+
+    in_flight -= reap(chunks);
+  }
+
+  // short reads (at the end of the file or interrupted), failures and the
+  // chunks left by an error in the ring are finished off with pread, which
+  // also reports real errors
+  for (chunk &c : chunks) {
+    if (c.done < c.size) {
+      c.done += pread_all(fd, c.offset + c.done, c.buffer + c.done,
+                          c.size - c.done);
+    }
+  }
+
+  // the data is only contiguous up to the first incomplete chunk
+  std::size_t total = 0;
+  for (const chunk &c : chunks) {
+    total += c.done;
+    if (c.done < c.size) {
+      break;
+    }
+  }
+
+  return total;
+}
+} // namespace npy
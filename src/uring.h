@@ -0,0 +1,88 @@
+// ----------------------------------------------------------------------------
+//
+// uring.h -- deep-queue positional reads through Linux io_uring
+//
+// Copyright (C) 2021 Matthew Johnson
+//
+// For conditions of distribution and use, see copyright notice in LICENSE
+//
+// ----------------------------------------------------------------------------
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace npy {
+/** An io_uring instance which splits a large read into chunks and keeps many
+ *  of them in flight at once, so that a single reader can saturate a fast
+ *  disk. Each thread has its own ring, so no locking is needed.
+ */
+class uring_reader {
+public:
+  /** Reads smaller than this are not worth splitting. */
+  static const std::size_t MIN_READ_SIZE = 1024 * 1024;
+
+  /** Returns the ring for the calling thread, creating it if needed.
+   *  \return the ring, or nullptr if io_uring is not available (e.g. the
+   *          kernel is too old or it has been disabled by seccomp)
+   */
+  static uring_reader *local();
+
+  ~uring_reader();
+
+  uring_reader(const uring_reader &) = delete;
+  uring_reader &operator=(const uring_reader &) = delete;
+
+  /** Reads from a file at an explicit offset.
+   *  \param fd the file descriptor
+   *  \param offset the offset in the file of the first byte to read
+   *  \param buffer the destination buffer
+   *  \param size the number of bytes to read
+   *  \return the number of bytes read, which is only less than \p size if
+   *          the end of the file was reached
+   */
+  std::size_t read(int fd, std::uint64_t offset, char *buffer,
+                   std::size_t size);
+
+  /** Makes calls to io_uring_enter on the calling thread report a failure
+   *  once they have been made, so that the recovery from errors can be
+   *  tested.
+   *  \param after the number of calls which succeed first
+   *  \param count the number of calls which then fail
+   */
+  static void fail_enter(unsigned after, unsigned count);
+
+private:
+  uring_reader();
+
+  struct chunk;
+
+  void submit(int fd, chunk &c, std::uint64_t index);
+  bool enter(unsigned to_submit, unsigned min_complete);
+  std::size_t reap(std::vector<chunk> &chunks);
+  void recover(std::vector<chunk> &chunks, std::size_t in_flight);
+
+  int m_fd;
+  bool m_valid;
+  void *m_sq_ring;
+  std::size_t m_sq_ring_size;
+  void *m_cq_ring;
+  std::size_t m_cq_ring_size;
+  void *m_sqes;
+  std::size_t m_sqes_size;
+  unsigned *m_sq_head;
+  unsigned *m_sq_tail;
+  unsigned *m_sq_mask;
+  unsigned *m_sq_array;
+  unsigned *m_cq_head;
+  unsigned *m_cq_tail;
+  unsigned *m_cq_mask;
+  void *m_cqes;
+  unsigned m_depth;
+};
+} // namespace npy
+
+#endif
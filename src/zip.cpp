@@ -4,8 +4,12 @@
 #else
 #include "miniz/miniz.h"
 #endif
-#include <cassert>
+#ifdef LIBNPY_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
@@ -19,145 +23,253 @@ const int MEM_LEVEL = 8;
 namespace npy {
 
 std::uint32_t npy_crc32(const std::string &bytes) {
-  uLong crc = ::crc32(0L, Z_NULL, 0);
-  const Bytef *buf = reinterpret_cast<const Bytef *>(bytes.data());
-  uInt len = static_cast<uInt>(bytes.size());
-  return ::crc32(crc, buf, len);
+  return npy_crc32(0, bytes.data(), bytes.size());
+}
+
+std::uint32_t npy_crc32(std::uint32_t crc, const char *data, std::size_t size) {
+#ifdef LIBNPY_USE_LIBDEFLATE
+  // libdeflate's CRC32 folds with carry-less multiplication where the CPU
+  // has it, which is many times quicker than miniz's tables
+  return libdeflate_crc32(crc, data, size);
+#else
+  const Bytef *buf = reinterpret_cast<const Bytef *>(data);
+  while (size > 0) {
+    uInt len = static_cast<uInt>(
+        std::min<std::size_t>(size, std::numeric_limits<uInt>::max()));
+    crc = static_cast<std::uint32_t>(::crc32(crc, buf, len));
+    buf += len;
+    size -= len;
+  }
+
+  return crc;
+#endif
+}
+
+namespace {
+// CRC32 combination follows zlib's crc32_combine(), which miniz lacks: the
+// checksum of the first block is advanced over size2 zero bytes by repeated
+// squaring of the operator which appends a single zero bit.
+std::uint32_t gf2_matrix_times(const std::uint32_t *mat, std::uint32_t vec) {
+  std::uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+
+    vec >>= 1;
+    mat++;
+  }
+
+  return sum;
+}
+
+void gf2_matrix_square(std::uint32_t *square, const std::uint32_t *mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+} // namespace
+
+std::uint32_t npy_crc32_combine(std::uint32_t crc1, std::uint32_t crc2,
+                                std::uint64_t size2) {
+  if (size2 == 0) {
+    return crc1;
+  }
+
+  std::uint32_t even[32];
+  std::uint32_t odd[32];
+
+  // operator for one zero bit in odd
+  odd[0] = 0xEDB88320;
+  std::uint32_t row = 1;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  // operators for two and four zero bits
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+
+  // apply size2 zero bytes to crc1 (the first squaring gives one zero byte)
+  do {
+    gf2_matrix_square(even, odd);
+    if (size2 & 1) {
+      crc1 = gf2_matrix_times(even, crc1);
+    }
+
+    size2 >>= 1;
+    if (size2 == 0) {
+      break;
+    }
+
+    gf2_matrix_square(odd, even);
+    if (size2 & 1) {
+      crc1 = gf2_matrix_times(odd, crc1);
+    }
+
+    size2 >>= 1;
+  } while (size2 != 0);
+
+  return crc1 ^ crc2;
+}
+
+std::string npy_deflate_block(const char *data, std::size_t size, bool last,
+                              int level) {
+  std::ostringstream output;
+  npy_deflater deflater(output, level);
+  deflater.write(data, size);
+  if (last) {
+    deflater.finish();
+  } else {
+    deflater.flush();
+  }
+
+  return output.str();
+}
+
+std::uint64_t npy_deflate_bound(std::uint64_t size) {
+  // the same bound as zlib's compressBound()
+  return size + (size >> 12) + (size >> 14) + (size >> 25) + 13;
 }
 
-std::string npy_deflate(std::string &&bytes) {
-  int ret, flush;
-  unsigned have;
+struct npy_deflater::state {
+  state(std::ostream &output) : output(output), out(CHUNK) {}
+
   z_stream strm;
-  std::vector<unsigned char> in(CHUNK);
-  std::vector<unsigned char> out(CHUNK);
+  std::ostream &output;
+  std::vector<unsigned char> out;
+};
 
-  /* allocate deflate state */
+npy_deflater::npy_deflater(std::ostream &output, int level)
+    : m_state(new state(output)) {
+  z_stream &strm = m_state->strm;
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
   strm.opaque = Z_NULL;
-  ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, WINDOW_BITS,
-                     MEM_LEVEL, Z_DEFAULT_STRATEGY);
+  // 0 would mean no compression at all to miniz, rather than the default
+  level = level <= 0 ? Z_DEFAULT_COMPRESSION
+                     : std::min<int>(level, MZ_UBER_COMPRESSION);
+  int ret = deflateInit2(&strm, level, Z_DEFLATED, WINDOW_BITS, MEM_LEVEL,
+                         Z_DEFAULT_STRATEGY);
   if (ret != Z_OK) {
     throw std::runtime_error("Unable to initialize deflate algorithm");
   }
+}
 
-  std::string str(bytes.begin(), bytes.end());
-  std::istringstream input(std::move(str));
-  std::ostringstream output;
+npy_deflater::~npy_deflater() { (void)deflateEnd(&m_state->strm); }
 
-  /* compress until end of file */
+namespace {
+void run_deflate(z_stream &strm, std::ostream &output,
+                 std::vector<unsigned char> &out, int flush) {
+  int ret;
   do {
-    input.read(reinterpret_cast<char *>(in.data()), CHUNK);
-    strm.avail_in = static_cast<uInt>(input.gcount());
-    if (input.eof()) {
-      flush = Z_FINISH;
-    } else {
-      if (input.fail() || input.bad()) {
-        (void)deflateEnd(&strm);
-        throw std::runtime_error("Error reading from input stream");
-      }
-
-      flush = Z_NO_FLUSH;
+    strm.avail_out = static_cast<uInt>(out.size());
+    strm.next_out = out.data();
+    ret = deflate(&strm, flush);
+    if (ret == Z_STREAM_ERROR) {
+      throw std::runtime_error("Error deflating stream");
     }
 
-    strm.next_in = in.data();
-
-    /* run deflate() on input until output buffer not full, finish
-       compression if all of source has been read in */
-    do {
-      strm.avail_out = CHUNK;
-      strm.next_out = out.data();
-      ret = deflate(&strm, flush);
-      assert(ret != Z_STREAM_ERROR); /* state not clobbered */
-      have = CHUNK - strm.avail_out;
-      output.write(reinterpret_cast<char *>(out.data()), have);
-      if (output.fail() || output.bad()) {
-        (void)deflateEnd(&strm);
-        throw std::runtime_error("Error writing to output stream");
-      }
-    } while (strm.avail_out == 0);
-    assert(strm.avail_in == 0); /* all input will be used */
-                                /* done when last data in file processed */
-  } while (flush != Z_FINISH);
-  assert(ret == Z_STREAM_END); /* stream will be complete */
-
-  /* clean up and return */
-  (void)deflateEnd(&strm);
+    std::size_t have = out.size() - strm.avail_out;
+    output.write(reinterpret_cast<char *>(out.data()), have);
+    if (output.fail() || output.bad()) {
+      throw std::runtime_error("Error writing to output stream");
+    }
+  } while (strm.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+}
+} // namespace
 
-  return output.str();
+void npy_deflater::write(const char *data, std::size_t size) {
+  const std::size_t max_step = std::numeric_limits<uInt>::max();
+  z_stream &strm = m_state->strm;
+  while (size > 0) {
+    uInt step = static_cast<uInt>(std::min(size, max_step));
+    strm.next_in = reinterpret_cast<const unsigned char *>(data);
+    strm.avail_in = step;
+    run_deflate(strm, m_state->output, m_state->out, Z_NO_FLUSH);
+    data += step;
+    size -= step;
+  }
 }
 
-std::string npy_inflate(std::string &&bytes) {
-  int ret;
-  unsigned have;
+void npy_deflater::flush() {
+  z_stream &strm = m_state->strm;
+  strm.next_in = Z_NULL;
+  strm.avail_in = 0;
+  run_deflate(strm, m_state->output, m_state->out, Z_SYNC_FLUSH);
+}
+
+void npy_deflater::finish() {
+  z_stream &strm = m_state->strm;
+  strm.next_in = Z_NULL;
+  strm.avail_in = 0;
+  run_deflate(strm, m_state->output, m_state->out, Z_FINISH);
+}
+
+struct npy_inflater::state {
   z_stream strm;
-  std::vector<unsigned char> in(CHUNK);
-  std::vector<unsigned char> out(CHUNK);
-  /* allocate inflate state */
+  bool finished;
+};
+
+npy_inflater::npy_inflater() : m_state(new state()) {
+  z_stream &strm = m_state->strm;
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
   strm.opaque = Z_NULL;
   strm.avail_in = 0;
   strm.next_in = Z_NULL;
-  ret = inflateInit2(&strm, WINDOW_BITS);
-  if (ret != Z_OK) {
+  m_state->finished = false;
+  if (inflateInit2(&strm, WINDOW_BITS) != Z_OK) {
     throw std::runtime_error("Unable to initialize inflate algorithm");
   }
+}
 
-  std::string str(bytes.begin(), bytes.end());
-  std::istringstream input(std::move(str));
-  std::ostringstream output;
+npy_inflater::~npy_inflater() { (void)inflateEnd(&m_state->strm); }
 
-  /* decompress until deflate stream ends or end of file */
-  do {
-    input.read(reinterpret_cast<char *>(in.data()), CHUNK);
-    strm.avail_in = static_cast<uInt>(input.gcount());
-    if ((input.fail() && !input.eof()) || input.bad()) {
-      (void)inflateEnd(&strm);
-      throw std::runtime_error("Error reading from input stream");
-    }
+bool npy_inflater::finished() const { return m_state->finished; }
 
-    if (strm.avail_in == 0) {
+std::size_t npy_inflater::decompress(const char *&input,
+                                     std::size_t &input_size, char *output,
+                                     std::size_t output_size) {
+  const std::size_t max_step = std::numeric_limits<uInt>::max();
+  z_stream &strm = m_state->strm;
+  std::size_t produced = 0;
+  while (!m_state->finished && produced < output_size) {
+    uInt avail_in = static_cast<uInt>(std::min(input_size, max_step));
+    uInt avail_out =
+        static_cast<uInt>(std::min(output_size - produced, max_step));
+    strm.next_in = reinterpret_cast<const unsigned char *>(input);
+    strm.avail_in = avail_in;
+    strm.next_out = reinterpret_cast<unsigned char *>(output + produced);
+    strm.avail_out = avail_out;
+
+    int ret = ::inflate(&strm, Z_NO_FLUSH);
+    switch (ret) {
+    case Z_STREAM_END:
+      m_state->finished = true;
       break;
+
+    case Z_OK:
+    case Z_BUF_ERROR:
+      break;
+
+    default:
+      throw std::runtime_error("Error inflating stream");
     }
 
-    strm.next_in = in.data();
-
-    /* run inflate() on input until output buffer not full */
-    do {
-      strm.avail_out = CHUNK;
-      strm.next_out = out.data();
-      ret = inflate(&strm, Z_NO_FLUSH);
-      assert(ret != Z_STREAM_ERROR); /* state not clobbered */
-      switch (ret) {
-      case Z_NEED_DICT:
-        ret = Z_DATA_ERROR; /* and fall through */
-      case Z_DATA_ERROR:
-      case Z_MEM_ERROR:
-        (void)inflateEnd(&strm);
-        throw std::runtime_error("Error inflating stream");
-      }
-
-      have = CHUNK - strm.avail_out;
-      output.write(reinterpret_cast<char *>(out.data()), have);
-      if (output.fail() || output.bad()) {
-        (void)inflateEnd(&strm);
-        throw std::runtime_error("Error writing to output stream");
-      }
-    } while (strm.avail_out == 0);
-
-    /* done when inflate() says it's done */
-  } while (ret != Z_STREAM_END);
-
-  /* clean up and return */
-  (void)inflateEnd(&strm);
-
-  if (ret == Z_STREAM_END) {
-    return output.str();
+    std::size_t consumed = avail_in - strm.avail_in;
+    std::size_t written = avail_out - strm.avail_out;
+    input += consumed;
+    input_size -= consumed;
+    produced += written;
+    if (consumed == 0 && written == 0) {
+      // more input is required to make progress
+      break;
+    }
   }
 
-  throw std::runtime_error("Error inflating stream");
+  return produced;
 }
 
 } // namespace npy
\ No newline at end of file
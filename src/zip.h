@@ -11,27 +11,118 @@
 #ifndef _ZIP_H_
 #define _ZIP_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <ostream>
 #include <string>
 
 namespace npy {
-/** Deflate the bytes and return the compressed result.
- *  \param bytes the raw bytes
+/** Perform a fast CRC32 checksum of a set of bytes.
+ *  \param bytes the bytes to check
+ *  \return the CRC32 checksum
+ */
+std::uint32_t npy_crc32(const std::string &bytes);
+
+/** Update a running CRC32 checksum with a set of bytes.
+ *  \param crc the checksum of the preceding bytes (0 for the first call)
+ *  \param data pointer to the bytes to check
+ *  \param size the number of bytes
+ *  \return the updated CRC32 checksum
+ */
+std::uint32_t npy_crc32(std::uint32_t crc, const char *data, std::size_t size);
+
+/** Combine the CRC32 checksums of two consecutive blocks of bytes.
+ *  \param crc1 the checksum of the first block
+ *  \param crc2 the checksum of the second block
+ *  \param size2 the size of the second block in bytes
+ *  \return the checksum of the two blocks concatenated
+ */
+std::uint32_t npy_crc32_combine(std::uint32_t crc1, std::uint32_t crc2,
+                                std::uint64_t size2);
+
+/** Deflate one block of a larger stream, independently of the other blocks.
+ *  All but the last block end with a sync flush instead of the end of stream
+ *  marker, so that the compressed blocks can be concatenated in order to
+ *  produce a single valid raw DEFLATE stream.
+ *  \param data pointer to the bytes
+ *  \param size the number of bytes
+ *  \param last whether this is the last block of the stream
+ *  \param level the compression level (see npy_deflater)
  *  \return the compressed bytes
  */
-std::string npy_deflate(std::string &&bytes);
+std::string npy_deflate_block(const char *data, std::size_t size, bool last,
+                              int level = 0);
 
-/** Inflate the bytes and return the decompressed result.
- *  \param bytes the compressed bytes
- *  \return the raw bytes
+/** Upper bound on the size of the raw DEFLATE stream for a number of bytes.
+ *  \param size the number of uncompressed bytes
+ *  \return the maximum number of compressed bytes
  */
-std::string npy_inflate(std::string &&bytes);
+std::uint64_t npy_deflate_bound(std::uint64_t size);
 
-/** Perform a fast CRC32 checksum of a set of bytes.
- *  \param bytes the bytes to check
- *  \return the CRC32 checksum
+/** Class which deflates data incrementally, writing the raw DEFLATE stream to
+ *  an output stream as it is produced.
  */
-std::uint32_t npy_crc32(const std::string &bytes);
+class npy_deflater {
+public:
+  /** Constructor.
+   *  \param output the stream which receives the compressed bytes
+   *  \param level the compression level, from 1 (fastest) to 10 (smallest,
+   *               but much slower). Higher levels are treated as 10, and 0
+   *               (or less) selects the default, which is level 6.
+   */
+  explicit npy_deflater(std::ostream &output, int level = 0);
+  ~npy_deflater();
+
+  npy_deflater(const npy_deflater &) = delete;
+  npy_deflater &operator=(const npy_deflater &) = delete;
+
+  /** Compress a block of bytes.
+   *  \param data pointer to the bytes
+   *  \param size the number of bytes
+   */
+  void write(const char *data, std::size_t size);
+
+  /** Write any pending output, ending on a byte boundary (Z_SYNC_FLUSH). */
+  void flush();
+
+  /** Finish the DEFLATE stream and write any pending output. */
+  void finish();
+
+private:
+  struct state;
+  std::unique_ptr<state> m_state;
+};
+
+/** Class which inflates a raw DEFLATE stream incrementally, so that the
+ *  compressed and decompressed data never need to be held in memory at once.
+ */
+class npy_inflater {
+public:
+  npy_inflater();
+  ~npy_inflater();
+
+  npy_inflater(const npy_inflater &) = delete;
+  npy_inflater &operator=(const npy_inflater &) = delete;
+
+  /** Inflate as much of the input as will fit into the output buffer.
+   *  \param input the compressed bytes. Advanced past the consumed bytes.
+   *  \param input_size the number of compressed bytes. Reduced by the number
+   *                    of consumed bytes.
+   *  \param output the output buffer
+   *  \param output_size the size of the output buffer
+   *  \return the number of bytes written to the output buffer
+   */
+  std::size_t decompress(const char *&input, std::size_t &input_size,
+                         char *output, std::size_t output_size);
+
+  /** Whether the end of the DEFLATE stream has been reached. */
+  bool finished() const;
+
+private:
+  struct state;
+  std::unique_ptr<state> m_state;
+};
 } // namespace npy
 
 #endif
\ No newline at end of file
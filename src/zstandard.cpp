@@ -0,0 +1,153 @@
+#include "zstandard.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include <zstd.h>
+
+namespace {
+void check(std::size_t result, const char *message) {
+  if (ZSTD_isError(result)) {
+    throw std::runtime_error(std::string(message) + ": " +
+                             ZSTD_getErrorName(result));
+  }
+}
+
+ZSTD_CCtx *create_cctx(int level) {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  if (cctx == nullptr) {
+    throw std::runtime_error("Unable to initialize zstd compression");
+  }
+
+  std::size_t result =
+      ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+  if (ZSTD_isError(result)) {
+    ZSTD_freeCCtx(cctx);
+    check(result, "Invalid zstd compression level");
+  }
+
+  return cctx;
+}
+} // namespace
+
+namespace npy {
+std::string npy_zstd_compress(const char *data, std::size_t size, int level) {
+  std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(create_cctx(level),
+                                                            ZSTD_freeCCtx);
+  std::string output(ZSTD_compressBound(size), '\0');
+  std::size_t result =
+      ZSTD_compress2(cctx.get(), output.data(), output.size(), data, size);
+  check(result, "Error compressing with zstd");
+  output.resize(result);
+  return output;
+}
+
+std::string npy_zstd_decompress(std::string &&bytes, std::uint64_t size) {
+  std::string output(static_cast<std::size_t>(size), '\0');
+  npy_zstd_decompressor decompressor;
+  const char *input = bytes.data();
+  std::size_t input_size = bytes.size();
+  std::size_t produced = 0;
+  while (produced < output.size()) {
+    std::size_t step = decompressor.decompress(
+        input, input_size, output.data() + produced, output.size() - produced);
+    if (step == 0) {
+      throw std::runtime_error("Compressed data is truncated");
+    }
+
+    produced += step;
+  }
+
+  return output;
+}
+
+std::uint64_t npy_zstd_bound(std::uint64_t size) {
+  // the same bound as ZSTD_compressBound(), which takes a size_t
+  const std::uint64_t small = 128 * 1024;
+  return size + (size >> 8) + (size < small ? (small - size) >> 11 : 0);
+}
+
+struct npy_zstd_compressor::state {
+  state(std::ostream &output, int level)
+      : cctx(create_cctx(level)), output(output),
+        out(ZSTD_CStreamOutSize()) {}
+
+  ~state() { ZSTD_freeCCtx(cctx); }
+
+  ZSTD_CCtx *cctx;
+  std::ostream &output;
+  std::vector<char> out;
+
+  void run(ZSTD_inBuffer &in, ZSTD_EndDirective mode) {
+    bool done = false;
+    while (!done) {
+      ZSTD_outBuffer buffer = {out.data(), out.size(), 0};
+      std::size_t remaining = ZSTD_compressStream2(cctx, &buffer, &in, mode);
+      check(remaining, "Error compressing with zstd");
+      output.write(out.data(), buffer.pos);
+      if (output.fail() || output.bad()) {
+        throw std::runtime_error("Error writing to output stream");
+      }
+
+      done = mode == ZSTD_e_end ? remaining == 0 : in.pos == in.size;
+    }
+  }
+};
+
+npy_zstd_compressor::npy_zstd_compressor(std::ostream &output, int level)
+    : m_state(new state(output, level)) {}
+
+npy_zstd_compressor::~npy_zstd_compressor() = default;
+
+void npy_zstd_compressor::write(const char *data, std::size_t size) {
+  ZSTD_inBuffer in = {data, size, 0};
+  m_state->run(in, ZSTD_e_continue);
+}
+
+void npy_zstd_compressor::finish() {
+  ZSTD_inBuffer in = {nullptr, 0, 0};
+  m_state->run(in, ZSTD_e_end);
+}
+
+struct npy_zstd_decompressor::state {
+  state() : dctx(ZSTD_createDCtx()) {
+    if (dctx == nullptr) {
+      throw std::runtime_error("Unable to initialize zstd decompression");
+    }
+  }
+
+  ~state() { ZSTD_freeDCtx(dctx); }
+
+  ZSTD_DCtx *dctx;
+};
+
+npy_zstd_decompressor::npy_zstd_decompressor() : m_state(new state()) {}
+
+npy_zstd_decompressor::~npy_zstd_decompressor() = default;
+
+std::size_t npy_zstd_decompressor::decompress(const char *&input,
+                                              std::size_t &input_size,
+                                              char *output,
+                                              std::size_t output_size) {
+  ZSTD_inBuffer in = {input, input_size, 0};
+  ZSTD_outBuffer out = {output, output_size, 0};
+  while (out.pos < out.size) {
+    std::size_t in_pos = in.pos;
+    std::size_t out_pos = out.pos;
+    check(ZSTD_decompressStream(m_state->dctx, &out, &in),
+          "Error decompressing with zstd");
+    if (in.pos == in_pos && out.pos == out_pos) {
+      if (in.pos < in.size) {
+        throw std::runtime_error("Error decompressing with zstd");
+      }
+
+      // more input is required to make progress
+      break;
+    }
+  }
+
+  input += in.pos;
+  input_size -= in.pos;
+  return out.pos;
+}
+} // namespace npy
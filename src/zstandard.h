@@ -0,0 +1,101 @@
+// ----------------------------------------------------------------------------
+//
+// zstandard.h -- Zstandard compression of NPZ members (ZIP method 93)
+//
+// Copyright (C) 2021 Matthew Johnson
+//
+// For conditions of distribution and use, see copyright notice in LICENSE
+//
+// ----------------------------------------------------------------------------
+
+#ifndef _ZSTANDARD_H_
+#define _ZSTANDARD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace npy {
+/** Compress a block of bytes as a single Zstandard frame. Frames can be
+ *  concatenated, and the result decompresses to the concatenated data.
+ *  \param data pointer to the bytes
+ *  \param size the number of bytes
+ *  \param level the compression level (0 for the library default)
+ *  \return the compressed bytes
+ */
+std::string npy_zstd_compress(const char *data, std::size_t size, int level);
+
+/** Decompress a Zstandard stream whose decompressed size is known.
+ *  \param bytes the compressed bytes (one or more frames)
+ *  \param size the size of the decompressed data
+ *  \return the decompressed bytes
+ */
+std::string npy_zstd_decompress(std::string &&bytes, std::uint64_t size);
+
+/** Upper bound on the size of a Zstandard frame for a number of bytes.
+ *  \param size the number of uncompressed bytes
+ *  \return the maximum number of compressed bytes
+ */
+std::uint64_t npy_zstd_bound(std::uint64_t size);
+
+/** Class which compresses data incrementally, writing a Zstandard frame to an
+ *  output stream as it is produced.
+ */
+class npy_zstd_compressor {
+public:
+  /** Constructor.
+   *  \param output the stream which receives the compressed bytes
+   *  \param level the compression level (0 for the library default)
+   */
+  npy_zstd_compressor(std::ostream &output, int level);
+  ~npy_zstd_compressor();
+
+  npy_zstd_compressor(const npy_zstd_compressor &) = delete;
+  npy_zstd_compressor &operator=(const npy_zstd_compressor &) = delete;
+
+  /** Compress a block of bytes.
+   *  \param data pointer to the bytes
+   *  \param size the number of bytes
+   */
+  void write(const char *data, std::size_t size);
+
+  /** End the frame and write any pending output. */
+  void finish();
+
+private:
+  struct state;
+  std::unique_ptr<state> m_state;
+};
+
+/** Class which decompresses a Zstandard stream incrementally. The stream may
+ *  hold several frames, so its end is given by the size of the decompressed
+ *  data rather than by the decompressor.
+ */
+class npy_zstd_decompressor {
+public:
+  npy_zstd_decompressor();
+  ~npy_zstd_decompressor();
+
+  npy_zstd_decompressor(const npy_zstd_decompressor &) = delete;
+  npy_zstd_decompressor &operator=(const npy_zstd_decompressor &) = delete;
+
+  /** Decompress as much of the input as will fit into the output buffer.
+   *  \param input the compressed bytes. Advanced past the consumed bytes.
+   *  \param input_size the number of compressed bytes. Reduced by the number
+   *                    of consumed bytes.
+   *  \param output the output buffer
+   *  \param output_size the size of the output buffer
+   *  \return the number of bytes written to the output buffer
+   */
+  std::size_t decompress(const char *&input, std::size_t &input_size,
+                         char *output, std::size_t output_size);
+
+private:
+  struct state;
+  std::unique_ptr<state> m_state;
+};
+} // namespace npy
+
+#endif
@@ -0,0 +1,90 @@
+#include <complex>
+#include <cstdint>
+
+#include "byteswap.h"
+#include "libnpy_tests.h"
+
+namespace {
+void test_kernel(int &result, size_t word_size) {
+  // odd lengths exercise the scalar tail after the vector kernels
+  for (size_t num_words : {0, 1, 3, 7, 16, 33, 1001}) {
+    std::string input(num_words * word_size, '\0');
+    for (size_t i = 0; i < input.size(); ++i) {
+      input[i] = static_cast<char>(i * 7 + 3);
+    }
+
+    std::string expected = input;
+    for (size_t i = 0; i < expected.size(); i += word_size) {
+      std::reverse(expected.begin() + i, expected.begin() + i + word_size);
+    }
+
+    std::string tag = "byteswap_" + std::to_string(word_size) + "x" +
+                      std::to_string(num_words);
+    std::string actual(input.size(), '\0');
+    npy::npy_byteswap(&actual[0], input.data(), num_words, word_size);
+    test::assert_equal(expected, actual, result, tag);
+
+    npy::npy_byteswap(&input[0], input.data(), num_words, word_size);
+    test::assert_equal(expected, input, result, tag + "_in_place");
+  }
+}
+
+template <typename T>
+void test_big_endian(int &result, const std::string &name, size_t word_size) {
+  npy::tensor<T> expected = test::test_tensor<T>({101, 37});
+
+  std::ostringstream little_stream;
+  npy::save(little_stream, expected, npy::endian_t::LITTLE);
+  std::ostringstream big_stream;
+  npy::save(big_stream, expected, npy::endian_t::BIG);
+
+  std::string little = little_stream.str();
+  std::string big = big_stream.str();
+  size_t offset = little.size() - expected.size() * sizeof(T);
+  for (size_t i = offset; i < little.size(); i += word_size) {
+    std::reverse(little.begin() + i, little.begin() + i + word_size);
+  }
+
+  std::string tag = "byteswap_" + name;
+  test::assert_equal(little.substr(offset), big.substr(offset), result,
+                     tag + "_write");
+
+  std::istringstream input(big);
+  npy::tensor<T> actual = npy::load<npy::tensor<T>>(input);
+  test::assert_equal(expected, actual, result, tag + "_read");
+}
+
+void test_complex_layout(int &result) {
+  // numpy stores each component of a complex number in the requested byte
+  // order, i.e. np.array([1 + 2j], dtype='>c8') is 3f800000 40000000
+  npy::tensor<std::complex<float>> tensor({1});
+  *tensor.data() = std::complex<float>(1, 2);
+  std::ostringstream output;
+  npy::save(output, tensor, npy::endian_t::BIG);
+  std::string actual = output.str().substr(output.str().size() - 8);
+  std::string expected("\x3f\x80\x00\x00\x40\x00\x00\x00", 8);
+  test::assert_equal(expected, actual, result, "byteswap_complex_layout");
+}
+} // namespace
+
+int test_byteswap() {
+  int result = EXIT_SUCCESS;
+
+  test_kernel(result, 2);
+  test_kernel(result, 4);
+  test_kernel(result, 8);
+
+  test_big_endian<std::uint16_t>(result, "uint16", 2);
+  test_big_endian<std::int16_t>(result, "int16", 2);
+  test_big_endian<std::uint32_t>(result, "uint32", 4);
+  test_big_endian<std::int32_t>(result, "int32", 4);
+  test_big_endian<std::uint64_t>(result, "uint64", 8);
+  test_big_endian<std::int64_t>(result, "int64", 8);
+  test_big_endian<float>(result, "float32", 4);
+  test_big_endian<double>(result, "float64", 8);
+  test_big_endian<std::complex<float>>(result, "complex64", 4);
+  test_big_endian<std::complex<double>>(result, "complex128", 8);
+  test_complex_layout(result);
+
+  return result;
+}
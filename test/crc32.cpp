@@ -19,5 +19,16 @@ int test_crc32() {
   int actual = npy::npy_crc32(bytes);
   int expected = 928602993;
   test::assert_equal(expected, actual, result, "crc32");
+
+  for (size_t split : {size_t(0), size_t(1), size_t(100), bytes.size() / 2,
+                       bytes.size()}) {
+    std::uint32_t crc1 = npy::npy_crc32(0, bytes.data(), split);
+    std::uint32_t crc2 =
+        npy::npy_crc32(0, bytes.data() + split, bytes.size() - split);
+    actual = npy::npy_crc32_combine(crc1, crc2, bytes.size() - split);
+    test::assert_equal(expected, actual, result,
+                       "crc32_combine_" + std::to_string(split));
+  }
+
   return result;
 }
\ No newline at end of file
@@ -76,6 +76,17 @@ void npzfilereader_invalid_file() {
   npy::npzfilereader stream(test::path_join({"assets", "test", "uint8.npy"}));
 }
 
+void npzstringreader_crc_mismatch() {
+  std::string bytes = test::read_asset("test.npz");
+  size_t header = bytes.find("\x93NUMPY");
+  size_t header_length = static_cast<std::uint8_t>(bytes[header + 8]) |
+                         static_cast<std::uint8_t>(bytes[header + 9]) << 8;
+  bytes[header + STATIC_HEADER_LENGTH + header_length + 10] ^= 0x01;
+
+  npy::npzstringreader stream(bytes);
+  stream.read<npy::tensor<std::uint8_t>>("color.npy");
+}
+
 typedef npy::tensor<std::uint8_t> tensor_t;
 
 } // namespace
@@ -119,6 +130,8 @@ int test_exceptions() {
       npzfilewriter_closed, tensor, result, "npzfilewriter_closed");
   test::assert_throws<std::runtime_error>(npzfilereader_invalid_file, result,
                                           "npzfilereader_invalid_file");
+  test::assert_throws<std::runtime_error>(npzstringreader_crc_mismatch, result,
+                                          "npzstringreader_crc_mismatch");
 
   std::remove("test.npz");
 
@@ -57,14 +57,24 @@ typedef std::function<int()> TestFunction;
 int main(int argc, char **argv) {
   std::map<std::string, TestFunction> tests;
 
+  tests["byteswap"] = test_byteswap;
   tests["crc32"] = test_crc32;
   tests["exceptions"] = test_exceptions;
+  tests["mmap_tensor"] = test_mmap_tensor;
+  tests["npy_append"] = test_npy_append;
+  tests["npy_batch"] = test_npy_batch;
   tests["npy_peek"] = test_npy_peek;
   tests["npy_read"] = test_npy_read;
+  tests["npy_slice"] = test_npy_slice;
   tests["npy_write"] = test_npy_write;
+  tests["npz_codec"] = test_npz_codec;
   tests["npz_peek"] = test_npz_peek;
   tests["npz_read"] = test_npz_read;
+  tests["npz_threads"] = test_npz_threads;
   tests["npz_write"] = test_npz_write;
+  tests["npz_zip64"] = test_npz_zip64;
+  tests["npz_zip64_large"] = test_npz_zip64_large;
+  tests["pread_file"] = test_pread_file;
   tests["tensor"] = test_tensor;
   tests["custom_tensor"] = test_custom_tensor;
 
@@ -8,14 +8,24 @@
 
 #include "npy/npy.h"
 
+int test_byteswap();
 int test_crc32();
 int test_exceptions();
+int test_mmap_tensor();
+int test_npy_append();
+int test_npy_batch();
 int test_npy_peek();
 int test_npy_read();
+int test_npy_slice();
 int test_npy_write();
+int test_npz_codec();
 int test_npz_peek();
 int test_npz_read();
+int test_npz_threads();
 int test_npz_write();
+int test_npz_zip64();
+int test_npz_zip64_large();
+int test_pread_file();
 int test_tensor();
 int test_custom_tensor();
 
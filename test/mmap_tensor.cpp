@@ -0,0 +1,99 @@
+#include <complex>
+
+#include "libnpy_tests.h"
+
+namespace {
+template <typename T>
+void test_map(int &result, const std::string &name,
+              bool fortran_order = false) {
+  npy::tensor<T> expected = test::test_tensor<T>({5, 2, 5});
+  if (fortran_order) {
+    expected = test::test_fortran_tensor<T>();
+  }
+
+  npy::mmap_tensor<T> actual(test::asset_path(name + ".npy"));
+  std::vector<T> actual_values(actual.begin(), actual.end());
+
+  std::string tag = "mmap_tensor_" + name;
+  test::assert_equal(expected.dtype(), actual.dtype(), result, tag + " dtype");
+  test::assert_equal(expected.fortran_order(), actual.fortran_order(), result,
+                     tag + " fortran_order");
+  test::assert_equal(expected.shape(), actual.shape(), result, tag + " shape");
+  test::assert_equal(expected.values(), actual_values, result, tag);
+}
+
+void test_save(int &result) {
+  npy::mmap_tensor<float> tensor(test::asset_path("float32.npy"));
+  std::ostringstream output;
+  npy::save(output, tensor, npy::endian_t::LITTLE);
+  test::assert_equal(test::read_asset("float32.npy"), output.str(), result,
+                     "mmap_tensor_save");
+}
+
+void map_wrong_dtype() {
+  npy::mmap_tensor<float> tensor(test::asset_path("uint8.npy"));
+}
+
+void map_wrong_endianness() {
+  if (npy::native_endian() == npy::endian_t::BIG) {
+    npy::mmap_tensor<std::int32_t> tensor(test::asset_path("int32.npy"));
+  } else {
+    npy::mmap_tensor<std::int32_t> tensor(test::asset_path("int32_big.npy"));
+  }
+}
+
+void map_overflow() {
+  // the product of the dimensions wraps around to zero
+  const std::string path = "temp_overflow.npy";
+  size_t dim = static_cast<size_t>(1) << (4 * sizeof(size_t));
+  {
+    std::ofstream output(path, std::ios::out | std::ios::binary);
+    npy::write_npy_header(output, "|u1", false, {dim, dim});
+  }
+
+  try {
+    npy::mmap_tensor<std::uint8_t> tensor(path);
+  } catch (...) {
+    std::filesystem::remove(path);
+    throw;
+  }
+
+  std::filesystem::remove(path);
+}
+
+void map_invalid_path() {
+  npy::mmap_tensor<float> tensor(
+      test::path_join({"does_not_exist", "bad.npy"}));
+}
+} // namespace
+
+int test_mmap_tensor() {
+  int result = EXIT_SUCCESS;
+
+  test_map<std::uint8_t>(result, "uint8");
+  test_map<std::uint8_t>(result, "uint8_fortran", true);
+  test_map<std::int8_t>(result, "int8");
+  test_map<std::uint16_t>(result, "uint16");
+  test_map<std::int16_t>(result, "int16");
+  test_map<std::uint32_t>(result, "uint32");
+  test_map<std::int32_t>(result, "int32");
+  test_map<std::uint64_t>(result, "uint64");
+  test_map<std::int64_t>(result, "int64");
+  test_map<float>(result, "float32");
+  test_map<double>(result, "float64");
+  test_map<std::complex<float>>(result, "complex64");
+  test_map<std::complex<double>>(result, "complex128");
+  test_map<npy::boolean>(result, "bool");
+  test_save(result);
+
+  test::assert_throws<std::runtime_error>(map_wrong_dtype, result,
+                                          "mmap_tensor_wrong_dtype");
+  test::assert_throws<std::runtime_error>(map_wrong_endianness, result,
+                                          "mmap_tensor_wrong_endianness");
+  test::assert_throws<std::runtime_error>(map_overflow, result,
+                                          "mmap_tensor_overflow");
+  test::assert_throws<std::invalid_argument>(map_invalid_path, result,
+                                             "mmap_tensor_invalid_path");
+
+  return result;
+}
@@ -0,0 +1,111 @@
+#include "libnpy_tests.h"
+
+namespace {
+const std::string TEMP_NPY = "temp_append.npy";
+
+npy::tensor<float> first_rows(const npy::tensor<float> &tensor, size_t rows) {
+  npy::tensor<float> result({rows, tensor.shape(1), tensor.shape(2)});
+  std::copy(tensor.begin(), tensor.begin() + result.size(), result.begin());
+  return result;
+}
+
+void _test_append(int &result) {
+  auto expected = test::test_tensor<float>({9, 4, 3});
+  const float *row = expected.data();
+  size_t row_size = 12;
+
+  npy::npyappender<float> appender(TEMP_NPY, {4, 3});
+  auto actual = npy::load<npy::tensor<float>>(TEMP_NPY);
+  test::assert_equal(first_rows(expected, 0), actual, result,
+                     "npy_append_empty");
+
+  appender.append(row, 5);
+  appender.flush();
+  actual = npy::load<npy::tensor<float>>(TEMP_NPY);
+  test::assert_equal(first_rows(expected, 5), actual, result,
+                     "npy_append_pointer");
+
+  // rows which have not been flushed are not yet visible
+  npy::tensor<float> block({3, 4, 3});
+  std::copy(row + 5 * row_size, row + 8 * row_size, block.begin());
+  appender.append(block);
+  actual = npy::load<npy::tensor<float>>(TEMP_NPY);
+  test::assert_equal(first_rows(expected, 5), actual, result,
+                     "npy_append_unflushed");
+
+  npy::tensor<float> single({4, 3});
+  std::copy(row + 8 * row_size, row + 9 * row_size, single.begin());
+  appender.append(single);
+  test::assert_equal(static_cast<size_t>(9), appender.rows(), result,
+                     "npy_append_rows");
+
+  appender.close();
+  test::assert_equal(false, appender.is_open(), result, "npy_append_closed");
+  actual = npy::load<npy::tensor<float>>(TEMP_NPY);
+  test::assert_equal(expected, actual, result, "npy_append_tensor");
+}
+
+void _test_append_vector(int &result, npy::endian_t endianness) {
+  auto expected = test::test_tensor<std::int32_t>({100000});
+  {
+    npy::npyappender<std::int32_t> appender(TEMP_NPY, {}, endianness);
+    for (int i = 0; i < 100000; i += 1000) {
+      appender.append(expected.data() + i, 1000);
+    }
+  }
+
+  auto actual = npy::load<npy::tensor<std::int32_t>>(TEMP_NPY);
+  std::string tag = endianness == npy::endian_t::BIG ? "npy_append_big"
+                                                     : "npy_append_little";
+  test::assert_equal(expected, actual, result, tag);
+}
+
+void _test_append_alignment(int &result) {
+  auto expected = test::test_tensor<double>({2, 5});
+  {
+    npy::npyappender<double> appender(TEMP_NPY, {5},
+                                      npy::endian_t::NATIVE, 4096);
+    appender.append(expected);
+  }
+
+  std::ifstream input(TEMP_NPY, std::ios::binary);
+  npy::read_npy_header(input);
+  test::assert_equal(static_cast<std::streamoff>(4096),
+                     static_cast<std::streamoff>(input.tellg()), result,
+                     "npy_append_alignment_offset");
+  input.close();
+
+  auto actual = npy::load<npy::tensor<double>>(TEMP_NPY);
+  test::assert_equal(expected, actual, result, "npy_append_alignment");
+}
+
+void append_wrong_shape() {
+  npy::npyappender<float> appender(TEMP_NPY, {4, 3});
+  npy::tensor<float> rows({2, 3, 4});
+  appender.append(rows);
+}
+
+void append_closed() {
+  npy::npyappender<float> appender(TEMP_NPY, {4, 3});
+  npy::tensor<float> row({4, 3});
+  appender.close();
+  appender.append(row);
+}
+} // namespace
+
+int test_npy_append() {
+  int result = EXIT_SUCCESS;
+
+  _test_append(result);
+  _test_append_vector(result, npy::endian_t::LITTLE);
+  _test_append_vector(result, npy::endian_t::BIG);
+  _test_append_alignment(result);
+  test::assert_throws<std::invalid_argument>(append_wrong_shape, result,
+                                             "npy_append_wrong_shape");
+  test::assert_throws<std::runtime_error>(append_closed, result,
+                                          "npy_append_closed");
+
+  std::filesystem::remove(TEMP_NPY);
+
+  return result;
+}
@@ -0,0 +1,105 @@
+#include <filesystem>
+
+#include "libnpy_tests.h"
+
+namespace {
+const std::string TEMP_DIR = "temp_batch";
+const int NUM_FILES = 50;
+
+std::string file_path(int index) {
+  return test::path_join({TEMP_DIR, std::to_string(index) + ".npy"});
+}
+
+npy::tensor<std::int32_t> file_tensor(int index) {
+  auto tensor = test::test_tensor<std::int32_t>(
+      {static_cast<size_t>(index % 7 + 1), 3});
+  for (auto &value : tensor) {
+    value += index;
+  }
+
+  return tensor;
+}
+
+std::vector<std::string> file_paths() {
+  std::vector<std::string> paths;
+  for (int i = 0; i < NUM_FILES; ++i) {
+    paths.push_back(file_path(i));
+  }
+
+  return paths;
+}
+
+void _test_next(int &result, std::size_t num_threads, std::size_t read_ahead) {
+  std::string tag = "npy_batch_next_" + std::to_string(num_threads) + "_" +
+                    std::to_string(read_ahead);
+  npy::batch_loader<npy::tensor<std::int32_t>> loader(file_paths(),
+                                                      num_threads, read_ahead);
+  test::assert_equal(static_cast<size_t>(NUM_FILES), loader.size(), result,
+                     tag + "_size");
+  for (int i = 0; i < NUM_FILES; ++i) {
+    test::assert_equal(true, loader.has_next(), result, tag + "_has_next");
+    test::assert_equal(file_tensor(i), loader.next(), result, tag);
+  }
+
+  test::assert_equal(false, loader.has_next(), result, tag + "_end");
+}
+
+void _test_for_each(int &result) {
+  npy::batch_loader<npy::tensor<std::int32_t>> loader(file_paths(), 4, 3);
+  int index = 0;
+  loader.for_each([&](npy::tensor<std::int32_t> &&tensor) {
+    test::assert_equal(file_tensor(index), tensor, result,
+                       "npy_batch_for_each");
+    index += 1;
+  });
+
+  test::assert_equal(NUM_FILES, index, result, "npy_batch_for_each_count");
+}
+
+void _test_missing(int &result) {
+  std::vector<std::string> paths = {file_path(0), file_path(NUM_FILES),
+                                    file_path(1)};
+  npy::batch_loader<npy::tensor<std::int32_t>> loader(paths, 2);
+  test::assert_equal(file_tensor(0), loader.next(), result,
+                     "npy_batch_missing_before");
+  bool thrown = false;
+  try {
+    loader.next();
+  } catch (std::invalid_argument &) {
+    thrown = true;
+  }
+
+  test::assert_equal(true, thrown, result, "npy_batch_missing");
+  test::assert_equal(file_tensor(1), loader.next(), result,
+                     "npy_batch_missing_after");
+}
+
+void batch_past_end() {
+  npy::batch_loader<npy::tensor<std::int32_t>> loader({file_path(0)}, 1);
+  loader.next();
+  loader.next();
+}
+} // namespace
+
+int test_npy_batch() {
+  int result = EXIT_SUCCESS;
+
+  std::filesystem::create_directories(TEMP_DIR);
+  for (int i = 0; i < NUM_FILES; ++i) {
+    auto tensor = file_tensor(i);
+    npy::save(file_path(i), tensor);
+  }
+
+  _test_next(result, 1, 1);
+  _test_next(result, 4, 0);
+  _test_next(result, 8, 64);
+  _test_next(result, 0, 0);
+  _test_for_each(result);
+  _test_missing(result);
+  test::assert_throws<std::runtime_error>(batch_past_end, result,
+                                          "npy_batch_past_end");
+
+  std::filesystem::remove_all(TEMP_DIR);
+
+  return result;
+}
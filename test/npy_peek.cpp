@@ -9,6 +9,83 @@ void test_peek(int &result, const std::string &tag, npy::data_type_t data_type,
   npy::header_info actual = npy::peek(test::asset_path(tag + ".npy"));
   test::assert_equal(expected, actual, result, tag);
 }
+
+void test_dictionary(int &result, const std::string &tag,
+                     const std::string &dictionary,
+                     const npy::header_info &expected) {
+  npy::header_info actual(dictionary);
+  test::assert_equal(expected, actual, result, "npy_peek_dictionary_" + tag);
+}
+
+void _test_header_version(int &result, const std::string &tag,
+                          const std::string &dtype,
+                          const std::vector<size_t> &shape, char version) {
+  std::ostringstream output;
+  npy::write_npy_header(output, dtype, false, shape);
+  std::string header = output.str();
+  test::assert_equal(version, header[6], result,
+                     "npy_peek_version_" + tag + "_written");
+  test::assert_equal(static_cast<size_t>(0), header.size() % 64, result,
+                     "npy_peek_version_" + tag + "_padded");
+  if (version == 3) {
+    return;
+  }
+
+  std::istringstream input(header);
+  npy::header_info expected(npy::data_type_t::FLOAT32, npy::endian_t::LITTLE,
+                            false, shape);
+  test::assert_equal(expected, npy::read_npy_header(input), result,
+                     "npy_peek_version_" + tag);
+}
+
+std::string raw_header(char version, const std::string &dictionary) {
+  std::string header = "\x93NUMPY";
+  header.push_back(version);
+  header.push_back(0);
+  size_t length_bytes = version == 1 ? 2 : 4;
+  for (size_t i = 0; i < length_bytes; ++i) {
+    header.push_back(static_cast<char>((dictionary.size() >> (8 * i)) & 0xFF));
+  }
+
+  return header + dictionary;
+}
+
+const std::string DICTIONARY =
+    "{'descr': '<f4', 'fortran_order': False, 'shape': (3,), }\n";
+
+void _test_raw_header(int &result, char version) {
+  std::istringstream input(raw_header(version, DICTIONARY));
+  npy::header_info expected(npy::data_type_t::FLOAT32, npy::endian_t::LITTLE,
+                            false, {3});
+  test::assert_equal(expected, npy::read_npy_header(input), result,
+                     "npy_peek_raw_v" + std::to_string(version));
+}
+
+void read_header(const std::string &bytes) {
+  std::istringstream input(bytes);
+  npy::read_npy_header(input);
+}
+
+void header_bad_magic() {
+  read_header("\x93NUMPZ" + raw_header(1, DICTIONARY).substr(6));
+}
+
+void header_bad_version() { read_header(raw_header(4, DICTIONARY)); }
+
+void header_truncated() {
+  std::string header = raw_header(2, DICTIONARY);
+  read_header(header.substr(0, header.size() - 5));
+}
+
+void dictionary_malformed() {
+  npy::header_info info(
+      "{'descr': '<f4', 'fortran_order': False, 'shape': (3,");
+}
+
+void dictionary_unsupported_dtype() {
+  npy::header_info info(
+      "{'descr': '<M8', 'fortran_order': False, 'shape': (3,), }");
+}
 } // namespace
 
 int test_npy_peek() {
@@ -28,5 +105,41 @@ int test_npy_peek() {
   test_peek(result, "float32", npy::data_type_t::FLOAT32);
   test_peek(result, "float64", npy::data_type_t::FLOAT64);
 
+  test_dictionary(
+      result, "numpy",
+      "{'descr': '<f4', 'fortran_order': False, 'shape': (2, 3), }       \n",
+      {npy::data_type_t::FLOAT32, npy::endian_t::LITTLE, false, {2, 3}});
+  test_dictionary(
+      result, "scalar", "{'descr': '>i8', 'fortran_order': True, 'shape': ()}",
+      {npy::data_type_t::INT64, npy::endian_t::BIG, true, {}});
+  test_dictionary(
+      result, "python2",
+      "{'descr': '|u1', 'fortran_order': False, 'shape': (4L, 5L), }",
+      {npy::data_type_t::UINT8, npy::endian_t::NATIVE, false, {4, 5}});
+  test_dictionary(
+      result, "double_quotes",
+      "{\"shape\":(7,),\"descr\":\"<u2\",\"fortran_order\":False}",
+      {npy::data_type_t::UINT16, npy::endian_t::LITTLE, false, {7}});
+  // a 40-dimensional shape needs a header longer than 255 bytes
+  _test_header_version(result, "1", "<f4",
+                       std::vector<size_t>(40, 1000000), 1);
+  _test_header_version(result, "2", "<f4",
+                       std::vector<size_t>(8000, 1000000), 2);
+  _test_header_version(result, "3", "<f4\xc3\xa9", {3}, 3);
+  _test_raw_header(result, 1);
+  _test_raw_header(result, 2);
+  _test_raw_header(result, 3);
+  test::assert_throws<std::runtime_error>(header_bad_magic, result,
+                                          "npy_peek_header_bad_magic");
+  test::assert_throws<std::runtime_error>(header_bad_version, result,
+                                          "npy_peek_header_bad_version");
+  test::assert_throws<std::runtime_error>(header_truncated, result,
+                                          "npy_peek_header_truncated");
+  test::assert_throws<std::runtime_error>(dictionary_malformed, result,
+                                          "npy_peek_dictionary_malformed");
+  test::assert_throws<std::invalid_argument>(
+      dictionary_unsupported_dtype, result,
+      "npy_peek_dictionary_unsupported_dtype");
+
   return result;
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <sstream>
+
+#include "libnpy_tests.h"
+
+namespace {
+/// Slices a tensor in memory, to compare against slices read from a stream.
+template <typename T>
+npy::tensor<T> slice(const npy::tensor<T> &tensor,
+                     const std::vector<npy::slice> &slices) {
+  npy::header_info info(tensor.dtype(), npy::endian_t::NATIVE,
+                        tensor.fortran_order(), tensor.shape());
+  npy::tensor<T> result(npy::slice_shape(info, slices),
+                        tensor.fortran_order());
+  std::vector<npy::slice> full = slices;
+  full.resize(3);
+  for (int i = 0; i < static_cast<int>(result.shape(0)); ++i) {
+    for (int j = 0; j < static_cast<int>(result.shape(1)); ++j) {
+      for (int k = 0; k < static_cast<int>(result.shape(2)); ++k) {
+        result(i, j, k) =
+            tensor(static_cast<int>(full[0].start + i * full[0].step),
+                   static_cast<int>(full[1].start + j * full[1].step),
+                   static_cast<int>(full[2].start + k * full[2].step));
+      }
+    }
+  }
+
+  return result;
+}
+
+template <typename T>
+void _test(int &result, const npy::tensor<T> &tensor, npy::endian_t endianness,
+           const std::string &tag) {
+  std::ostringstream output;
+  npy::save(output, tensor, endianness);
+  std::string bytes = output.str();
+
+  std::vector<std::vector<npy::slice>> cases = {
+      {},
+      {{1, 3}},
+      {{0, 6}, {1, 2}},
+      {{2, 3}, {1, 4}, {2, 5}},
+      {{0, 6, 2}, {0, 5, 3}, {1, 7, 2}},
+      {{4, 6}, {}, {0, 7, 3}},
+      {{}, {}, {3, 4}},
+      {{1, 100}, {4, 100}, {6, 100}},
+  };
+
+  for (size_t c = 0; c < cases.size(); ++c) {
+    std::istringstream input(bytes);
+    auto actual = npy::load_slice<T>(input, cases[c]);
+    test::assert_equal(slice(tensor, cases[c]), actual, result,
+                       "npy_slice_" + tag + "_" + std::to_string(c));
+  }
+
+  std::istringstream input(bytes);
+  auto empty = npy::load_slice<T>(input, {{3, 3}});
+  test::assert_equal(size_t(0), empty.size(), result,
+                     "npy_slice_" + tag + "_empty");
+}
+
+template <typename T> npy::tensor<T> fortran_tensor(npy::tensor<T> tensor) {
+  npy::tensor<T> result(tensor.shape(), true);
+  for (int i = 0; i < static_cast<int>(tensor.shape(0)); ++i) {
+    for (int j = 0; j < static_cast<int>(tensor.shape(1)); ++j) {
+      for (int k = 0; k < static_cast<int>(tensor.shape(2)); ++k) {
+        result(i, j, k) = tensor(i, j, k);
+      }
+    }
+  }
+
+  return result;
+}
+
+void slice_zero_step() {
+  std::istringstream input(test::npy_stream<std::int32_t>());
+  npy::load_slice<std::int32_t>(input, {{0, 1, 0}});
+}
+
+void slice_too_many_axes() {
+  std::istringstream input(test::npy_stream<std::int32_t>());
+  npy::load_slice<std::int32_t>(input, {{}, {}, {}, {}});
+}
+} // namespace
+
+int test_npy_slice() {
+  int result = EXIT_SUCCESS;
+
+  auto int_tensor = test::test_tensor<std::int32_t>({6, 5, 7});
+  _test(result, int_tensor, npy::endian_t::LITTLE, "int32");
+  _test(result, int_tensor, npy::endian_t::BIG, "int32_big");
+  _test(result, fortran_tensor(int_tensor), npy::endian_t::LITTLE,
+        "int32_fortran");
+  _test(result, test::test_tensor<double>({6, 5, 7}), npy::endian_t::BIG,
+        "float64_big");
+  _test(result, test::test_tensor<std::wstring>({6, 5, 7}),
+        npy::endian_t::LITTLE, "unicode");
+
+  // rows of a C-order tensor (or columns of a FORTRAN-order one) are a
+  // single contiguous run of the data
+  size_t num_runs = 0;
+  npy::header_info c_info(npy::data_type_t::INT32, npy::endian_t::LITTLE, false,
+                          {6, 5, 7});
+  npy::for_each_slice_run(c_info, {{1, 3}},
+                          [&](std::uint64_t offset, size_t count) {
+                            num_runs += 1;
+                            test::assert_equal(std::uint64_t(35), offset,
+                                               result, "npy_slice_rows_offset");
+                            test::assert_equal(size_t(70), count, result,
+                                               "npy_slice_rows_count");
+                          });
+  test::assert_equal(size_t(1), num_runs, result, "npy_slice_rows_runs");
+
+  num_runs = 0;
+  npy::header_info f_info(npy::data_type_t::INT32, npy::endian_t::LITTLE, true,
+                          {6, 5, 7});
+  npy::for_each_slice_run(f_info, {{}, {}, {3, 4}},
+                          [&](std::uint64_t, size_t) { num_runs += 1; });
+  test::assert_equal(size_t(1), num_runs, result, "npy_slice_columns_runs");
+
+  test::assert_throws<std::invalid_argument>(slice_zero_step, result,
+                                             "npy_slice_zero_step");
+  test::assert_throws<std::invalid_argument>(slice_too_many_axes, result,
+                                             "npy_slice_too_many_axes");
+
+  return result;
+}
@@ -1,5 +1,90 @@
 #include "libnpy_tests.h"
 #include <complex>
+#include <filesystem>
+#include <new>
+
+namespace {
+const std::string TEMP_NPY = "temp_direct.npy";
+
+void _test_aligned_header(int &result) {
+  std::ostringstream output;
+  npy::write_npy_header(output, "<f4", false, {3, 4}, 4096);
+  std::string header = output.str();
+  test::assert_equal(static_cast<size_t>(4096), header.size(), result,
+                     "npy_write_aligned_header_size");
+
+  std::istringstream input(header);
+  npy::header_info expected(npy::data_type_t::FLOAT32, npy::endian_t::LITTLE,
+                            false, {3, 4});
+  test::assert_equal(expected, npy::read_npy_header(input), result,
+                     "npy_write_aligned_header");
+}
+
+void aligned_header_invalid() {
+  std::ostringstream output;
+  npy::write_npy_header(output, "<f4", false, {3, 4}, 100);
+}
+
+void _test_alignment(int &result, size_t alignment, char version) {
+  std::string tag = "npy_write_alignment_" + std::to_string(alignment);
+  auto expected = test::test_tensor<float>({5, 2, 5});
+  std::ostringstream output;
+  npy::save(output, expected, npy::endian_t::LITTLE, alignment);
+  std::string actual = output.str();
+  size_t data_size = expected.size() * sizeof(float);
+  size_t header_size = actual.size() - data_size;
+  test::assert_equal(static_cast<size_t>(0), header_size % alignment, result,
+                     tag + "_size");
+  test::assert_equal(static_cast<std::uint64_t>(actual.size()),
+                     npy::saved_size(expected, npy::endian_t::LITTLE,
+                                     alignment),
+                     result, tag + "_saved_size");
+  test::assert_equal(version, actual[6], result, tag + "_version");
+  test::assert_equal('\n', actual[header_size - 1], result,
+                     tag + "_newline");
+
+  std::istringstream input(actual);
+  test::assert_equal(expected, npy::load<npy::tensor<float>>(input), result,
+                     tag);
+}
+
+template <typename T>
+void _test_direct(int &result, const std::string &tag,
+                  npy::endian_t endianness) {
+  auto expected = test::test_tensor<T>({300, 257});
+  npy::save_direct(TEMP_NPY, expected, endianness);
+  test::assert_equal(static_cast<std::uintmax_t>(4096 + 300 * 257 * sizeof(T)),
+                     std::filesystem::file_size(TEMP_NPY), result,
+                     "npy_write_direct_size_" + tag);
+  test::assert_equal(expected, npy::load<npy::tensor<T>>(TEMP_NPY), result,
+                     "npy_write_direct_" + tag);
+}
+
+void _test_direct_stream(int &result) {
+  const size_t alignment = npy::odirectstream::ALIGNMENT;
+  const size_t size = 3 * alignment + 100;
+  char *aligned = static_cast<char *>(
+      ::operator new(size, std::align_val_t(alignment)));
+  std::string expected;
+  for (size_t i = 0; i < alignment + size + 5; ++i) {
+    expected.push_back(static_cast<char>(i * 7));
+  }
+
+  std::copy(expected.begin() + alignment, expected.end() - 5, aligned);
+  {
+    npy::odirectstream output(TEMP_NPY);
+    output.write(expected.data(), alignment);
+    // staged data is a whole block, so this is written without a copy
+    output.write(aligned, size);
+    output.write(expected.data() + alignment + size, 5);
+    output.close();
+  }
+
+  ::operator delete(aligned, std::align_val_t(alignment));
+  test::assert_equal(expected, test::read_file(TEMP_NPY), result,
+                     "npy_write_direct_stream");
+}
+} // namespace
 
 int test_npy_write() {
   int result = EXIT_SUCCESS;
@@ -82,5 +167,17 @@ int test_npy_write() {
   actual = test::npy_stream<npy::boolean>();
   test::assert_equal(expected, actual, result, "npy_write_bool");
 
+  _test_alignment(result, 64, 1);
+  _test_alignment(result, 4096, 1);
+  _test_alignment(result, 2 * 1024 * 1024, 2);
+  _test_aligned_header(result);
+  test::assert_throws<std::invalid_argument>(
+      aligned_header_invalid, result, "npy_write_aligned_header_invalid");
+  _test_direct<float>(result, "float32", npy::endian_t::LITTLE);
+  _test_direct<std::int32_t>(result, "int32_big", npy::endian_t::BIG);
+  _test_direct<std::uint8_t>(result, "uint8", npy::endian_t::NATIVE);
+  _test_direct_stream(result);
+  std::filesystem::remove(TEMP_NPY);
+
   return result;
 };
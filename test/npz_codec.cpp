@@ -0,0 +1,204 @@
+#include "libnpy_tests.h"
+
+namespace {
+const std::string TEMP_NPZ = "temp_codec.npz";
+const npy::compression_method_t XOR_METHOD =
+    static_cast<npy::compression_method_t>(200);
+const npy::compression_method_t FAILING_METHOD =
+    static_cast<npy::compression_method_t>(201);
+
+/// A codec which can only compress and decompress whole buffers
+class xor_codec : public npy::codec {
+public:
+  npy::compression_method_t method() const override { return XOR_METHOD; }
+
+  std::string name() const override { return "xor"; }
+
+  std::uint32_t flags() const override { return 0; }
+
+  std::uint64_t bound(std::uint64_t size) const override { return size; }
+
+  std::string compress(const char *data, std::size_t size,
+                       int) const override {
+    std::string bytes(data, size);
+    for (auto &byte : bytes) {
+      byte ^= 0x5A;
+    }
+
+    return bytes;
+  }
+
+  std::string decompress(std::string &&bytes, std::uint64_t) const override {
+    return compress(bytes.data(), bytes.size(), 0);
+  }
+};
+
+/// A codec which fails to compress anything
+class failing_codec : public xor_codec {
+public:
+  npy::compression_method_t method() const override { return FAILING_METHOD; }
+
+  std::string name() const override { return "failing"; }
+
+  std::string compress(const char *, std::size_t, int) const override {
+    throw std::runtime_error("compress");
+  }
+};
+
+void _test_registry(int &result) {
+  auto deflated = npy::find_codec(npy::compression_method_t::DEFLATED);
+  test::assert_equal(true, deflated != nullptr, result,
+                     "npz_codec_registry_deflated");
+  test::assert_equal(true,
+                     (deflated->flags() & npy::codec::STREAMING) != 0 &&
+                         (deflated->flags() & npy::codec::BLOCKS) != 0,
+                     result, "npz_codec_registry_flags");
+#ifdef LIBNPY_USE_LIBDEFLATE
+  test::assert_equal(std::string("libdeflate"), deflated->name(), result,
+                     "npz_codec_registry_libdeflate");
+  test::assert_equal(true, (deflated->flags() & npy::codec::ONE_SHOT) != 0,
+                     result, "npz_codec_registry_one_shot");
+#endif
+  test::assert_equal(true,
+                     npy::find_codec(npy::compression_method_t::STORED) ==
+                         nullptr,
+                     result, "npz_codec_registry_stored");
+  test::assert_equal(true, npy::find_codec(XOR_METHOD) == nullptr, result,
+                     "npz_codec_registry_missing");
+
+  npy::register_codec(std::make_shared<xor_codec>());
+  std::vector<std::string> names;
+  for (auto &codec : npy::registered_codecs()) {
+    names.push_back(codec->name());
+  }
+
+  test::assert_equal(std::string("xor"), names.back(), result,
+                     "npz_codec_registry_names");
+}
+
+void _test_round_trip(int &result) {
+  // large and compressible enough that the decompressor holds back output
+  // after it has consumed all of the input
+  std::ostringstream output;
+  npy::save(output, test::test_tensor<float>({64, 128, 129}));
+  std::string expected = output.str();
+  for (auto &codec : npy::registered_codecs()) {
+    std::string bytes = codec->compress(expected.data(), expected.size(), 0);
+    std::string actual = codec->decompress(std::move(bytes), expected.size());
+    test::assert_equal(true, expected == actual, result,
+                       "npz_codec_round_trip_" + codec->name());
+  }
+}
+
+void _test_buffered(int &result, size_t num_threads) {
+  auto expected = test::test_tensor<float>({64, 128, 129});
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, XOR_METHOD, npy::endian_t::NATIVE,
+                           num_threads, 100000);
+    npz.write("large", expected);
+    npz.write("color", test::test_tensor<std::uint8_t>({5, 5, 3}));
+  }
+
+  std::string tag = num_threads ? "npz_codec_buffered_threads"
+                                : "npz_codec_buffered";
+  npy::npzfilereader npz(TEMP_NPZ);
+  test::assert_equal(expected, npz.read<npy::tensor<float>>("large"), result,
+                     tag);
+  test::assert_equal(test::test_tensor<std::uint8_t>({5, 5, 3}),
+                     npz.read<npy::tensor<std::uint8_t>>("color"), result,
+                     tag + "_color");
+  test::assert_equal(expected.shape(), npz.peek("large").shape, result,
+                     tag + "_peek");
+  npz.close();
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+
+void _test_per_member(int &result) {
+  auto color = test::test_tensor<std::uint8_t>({5, 5, 3});
+  auto depth = test::test_tensor<float>({5, 5});
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, npy::compression_method_t::DEFLATED);
+    npz.write("color", color);
+    npz.write("depth", depth, npy::compression_method_t::STORED);
+    npz.write("xor", depth, XOR_METHOD);
+  }
+
+  npy::npzfilereader npz(TEMP_NPZ);
+  std::vector<std::uint16_t> methods;
+  for (auto &info : npz.manifest()) {
+    methods.push_back(info.entry.compression_method);
+  }
+
+  test::assert_equal(std::vector<std::uint16_t>({8, 0, 200}), methods, result,
+                     "npz_codec_per_member_methods");
+  test::assert_equal(color, npz.read<npy::tensor<std::uint8_t>>("color"),
+                     result, "npz_codec_per_member_color");
+  test::assert_equal(depth, npz.read<npy::tensor<float>>("depth"), result,
+                     "npz_codec_per_member_depth");
+  test::assert_equal(depth, npz.read<npy::tensor<float>>("xor"), result,
+                     "npz_codec_per_member_xor");
+  npz.close();
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+
+void _test_failed_close(int &result) {
+  npy::register_codec(std::make_shared<failing_codec>());
+  auto color = test::test_tensor<std::uint8_t>({5, 5, 3});
+
+  // the error from a worker is rethrown by an explicit close...
+  bool thrown = false;
+  try {
+    npy::npzstringwriter npz(FAILING_METHOD, npy::endian_t::NATIVE, 2);
+    npz.write("color", color);
+    npz.close();
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+
+  test::assert_equal(true, thrown, result, "npz_codec_failed_close");
+
+  // ...and ignored by the destructor, rather than terminating
+  {
+    npy::npzstringwriter npz(FAILING_METHOD, npy::endian_t::NATIVE, 2);
+    try {
+      npz.write("color", color);
+    } catch (std::runtime_error &) {
+    }
+  }
+}
+
+void register_stored() {
+  class stored_codec : public xor_codec {
+  public:
+    npy::compression_method_t method() const override {
+      return npy::compression_method_t::STORED;
+    }
+  };
+
+  npy::register_codec(std::make_shared<stored_codec>());
+}
+
+void xor_streaming() {
+  xor_codec codec;
+  codec.decompressor();
+}
+} // namespace
+
+int test_npz_codec() {
+  int result = EXIT_SUCCESS;
+
+  _test_registry(result);
+  _test_round_trip(result);
+  _test_buffered(result, 0);
+  _test_buffered(result, 3);
+  _test_per_member(result);
+  _test_failed_close(result);
+  test::assert_throws<std::invalid_argument>(register_stored, result,
+                                             "npz_codec_register_stored");
+  test::assert_throws<std::logic_error>(xor_streaming, result,
+                                        "npz_codec_streaming_unsupported");
+
+  return result;
+}
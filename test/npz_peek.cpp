@@ -32,6 +32,128 @@ void _test(int &result, const std::string &filename, bool compressed) {
   test::assert_equal(expected_depth, actual_depth, result,
                      "npz_peek_depth" + suffix);
 }
+
+void _test_partial(int &result, npy::compression_method_t compression) {
+  const std::string path = "temp_peek.npz";
+  auto tensor = test::test_tensor<float>({256, 256});
+  {
+    npy::npzfilewriter npz(path, compression, npy::endian_t::LITTLE);
+    npz.write("tensor", tensor);
+  }
+
+  // damage the data well past the header, which only a full read will see
+  std::uintmax_t size = std::filesystem::file_size(path);
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(static_cast<std::streamoff>(size / 2));
+    file.put(0x55);
+    file.seekp(static_cast<std::streamoff>(size / 2 + 1));
+    file.put(static_cast<char>(0xAA));
+  }
+
+  bool stored = compression == npy::compression_method_t::STORED;
+  std::string tag = stored ? "npz_peek_partial" : "npz_peek_partial_compressed";
+  npy::header_info expected(npy::data_type_t::FLOAT32, npy::endian_t::LITTLE,
+                            false, {256, 256});
+  npy::npzfilereader reader(path);
+  test::assert_equal(expected, reader.peek("tensor"), result, tag);
+
+  npy::npzstringreader string_reader(test::read_file(path));
+  test::assert_equal(expected, string_reader.peek("tensor"), result,
+                     tag + "_string");
+
+  bool thrown = false;
+  try {
+    reader.read<npy::tensor<float>>("tensor");
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+
+  test::assert_equal(true, thrown, result, tag + "_read");
+  reader.close();
+  std::filesystem::remove(path);
+}
+
+void _test_manifest(int &result, npy::compression_method_t compression,
+                    size_t num_threads) {
+  const std::string path = "temp_manifest.npz";
+  auto color = test::test_tensor<std::uint8_t>({5, 5, 3});
+  auto depth = test::test_tensor<float>({64, 32});
+  {
+    npy::npzfilewriter npz(path, compression);
+    npz.write("depth", depth);
+    npz.write("color", color);
+  }
+
+  bool stored = compression == npy::compression_method_t::STORED;
+  std::string tag = std::string("npz_manifest") +
+                    (stored ? "" : "_compressed") + "_" +
+                    std::to_string(num_threads);
+  npy::npzfilereader reader(path);
+  std::vector<npy::member_info> manifest = reader.manifest(num_threads);
+  test::assert_equal(static_cast<size_t>(2), manifest.size(), result,
+                     tag + "_size");
+  if (manifest.size() == 2) {
+    const npy::member_info &info = manifest[1];
+    test::assert_equal(std::string("depth.npy"), info.entry.filename, result,
+                       tag + "_name");
+    test::assert_equal(static_cast<std::uint16_t>(compression),
+                       info.entry.compression_method, result,
+                       tag + "_compression");
+    test::assert_equal(reader.peek("depth"), info.header, result,
+                       tag + "_header");
+    test::assert_equal(npy::saved_size(depth),
+                       info.header_size + depth.size() * sizeof(float),
+                       result, tag + "_header_size");
+    test::assert_equal(npy::saved_size(depth), info.entry.uncompressed_size,
+                       result, tag + "_uncompressed_size");
+    test::assert_equal(std::vector<size_t>({5, 5, 3}), manifest[0].header.shape,
+                       result, tag + "_color");
+
+    if (stored) {
+      // the values can be read straight from the archive
+      test::assert_equal(reader.data_offset("depth"),
+                         info.data_offset + info.header_size, result,
+                         tag + "_data_offset");
+    }
+  }
+
+  reader.close();
+  std::filesystem::remove(path);
+}
+void _test_manifest_invalid(int &result) {
+  const std::string path = "temp_manifest.npz";
+  {
+    npy::npzfilewriter npz(path);
+    npz.write("color", test::test_tensor<std::uint8_t>({5, 5, 3}));
+    npz.write("depth", test::test_tensor<float>({5, 5}));
+  }
+
+  // damage the magic string of one file, so that it is no longer an NPY
+  std::uint64_t offset;
+  {
+    npy::npzfilereader reader(path);
+    offset = reader.manifest()[1].data_offset;
+  }
+
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.put('X');
+  }
+
+  npy::npzfilereader reader(path);
+  bool thrown = false;
+  try {
+    reader.manifest();
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+
+  test::assert_equal(true, thrown, result, "npz_manifest_invalid");
+  reader.close();
+  std::filesystem::remove(path);
+}
 } // namespace
 
 int test_npz_peek() {
@@ -39,6 +161,12 @@ int test_npz_peek() {
 
   _test(result, "test.npz", false);
   _test(result, "test_compressed.npz", true);
+  _test_partial(result, npy::compression_method_t::STORED);
+  _test_partial(result, npy::compression_method_t::DEFLATED);
+  _test_manifest(result, npy::compression_method_t::STORED, 0);
+  _test_manifest(result, npy::compression_method_t::DEFLATED, 0);
+  _test_manifest(result, npy::compression_method_t::DEFLATED, 4);
+  _test_manifest_invalid(result);
 
   return result;
 }
\ No newline at end of file
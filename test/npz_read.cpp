@@ -57,6 +57,182 @@ void _test_memory(int &result, const std::string &filename) {
   test::assert_equal(expected_unicode, actual_unicode, result,
                      "npz_read_unicode_memory");
 }
+
+void _test_stored(int &result) {
+  auto expected_color = test::test_tensor<std::uint8_t>({5, 5, 3});
+  auto expected_float = test::test_tensor<float>({1000, 5, 20, 10});
+
+  npy::npzfilereader stream(test::asset_path("test.npz"));
+  std::uint64_t offset = stream.data_offset("color");
+  std::ifstream input(test::asset_path("test.npz"),
+                      std::ios::in | std::ios::binary);
+  input.seekg(offset);
+  std::vector<std::uint8_t> raw(expected_color.size());
+  input.read(reinterpret_cast<char *>(raw.data()), raw.size());
+  test::assert_equal(expected_color.values(), raw, result,
+                     "npz_read_stored_offset");
+
+  auto mapped_color = stream.map<std::uint8_t>("color.npy");
+  test::assert_equal(expected_color.shape(), mapped_color.shape(), result,
+                     "npz_read_stored_map_shape");
+  test::assert_equal(expected_color.values(),
+                     std::vector<std::uint8_t>(mapped_color.begin(),
+                                               mapped_color.end()),
+                     result, "npz_read_stored_map");
+
+  npy::npzfilereader large(test::asset_path("test_large.npz"));
+  auto actual_float = large.read_slice<float>("test_float", {{10, 12}, {3, 5}});
+  test::assert_equal(std::vector<size_t>({2, 2, 20, 10}), actual_float.shape(),
+                     result, "npz_read_stored_slice_shape");
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      test::assert_equal(expected_float(10 + i, 3 + j, 7, 5),
+                         actual_float(i, j, 7, 5), result,
+                         "npz_read_stored_slice");
+    }
+  }
+}
+
+void _test_index(int &result, bool lazy) {
+  const std::string path = "temp_index.npz";
+  {
+    npy::npzfilewriter npz(path);
+    npz.write("b", test::test_tensor<float>({2, 2}));
+    npz.write("a", test::test_tensor<float>({3}));
+    npz.write("c.npy", test::test_tensor<std::int32_t>({4, 1}));
+  }
+
+  std::string tag = lazy ? "npz_read_lazy" : "npz_read_index";
+  npy::npzfilereader reader(path, lazy);
+  // the first lookup in a lazy index scans the directory, and the rest use
+  // the tables
+  test::assert_equal(std::vector<size_t>({3}), reader.peek("a").shape, result,
+                     tag + "_first");
+  test::assert_equal(test::test_tensor<std::int32_t>({4, 1}),
+                     reader.read<npy::tensor<std::int32_t>>("c"), result,
+                     tag + "_read");
+  test::assert_equal(true, reader.contains("b.npy"), result,
+                     tag + "_contains");
+  test::assert_equal(false, reader.contains("b"), result,
+                     tag + "_contains_suffix");
+  test::assert_equal(std::vector<std::string>({"a.npy", "b.npy", "c.npy"}),
+                     reader.keys(), result, tag + "_keys");
+
+  bool thrown = false;
+  try {
+    reader.peek("d");
+  } catch (std::invalid_argument &) {
+    thrown = true;
+  }
+
+  test::assert_equal(true, thrown, result, tag + "_missing");
+  reader.close();
+  std::filesystem::remove(path);
+}
+
+template <typename T> void put(std::string &bytes, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    bytes.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+  }
+}
+
+/// A central directory header which records only a name and an offset.
+void put_directory_header(std::string &directory, const std::string &name,
+                          std::uint32_t offset) {
+  put<std::uint32_t>(directory, 0x02014B50);
+  put<std::uint16_t>(directory, 20); // version made by
+  put<std::uint16_t>(directory, 20); // version needed
+  put<std::uint16_t>(directory, 0);  // flags
+  put<std::uint16_t>(directory, 0);  // compression method
+  put<std::uint16_t>(directory, 0);  // modification time
+  put<std::uint16_t>(directory, 0);  // modification date
+  put<std::uint32_t>(directory, 0);  // CRC32
+  put<std::uint32_t>(directory, 0);  // compressed size
+  put<std::uint32_t>(directory, 0);  // uncompressed size
+  put<std::uint16_t>(directory, static_cast<std::uint16_t>(name.size()));
+  put<std::uint16_t>(directory, 0); // extra field length
+  put<std::uint16_t>(directory, 0); // comment length
+  put<std::uint16_t>(directory, 0); // disk number
+  put<std::uint16_t>(directory, 0); // internal attributes
+  put<std::uint32_t>(directory, 0); // external attributes
+  put<std::uint32_t>(directory, offset);
+  directory += name;
+}
+
+void _test_index_precedence(int &result, bool lazy) {
+  // names which the writer would not produce: one without the suffix, and
+  // one which appears twice
+  std::string directory;
+  put_directory_header(directory, "b.npy", 0);
+  put_directory_header(directory, "a", 1);
+  put_directory_header(directory, "a.npy", 2);
+  put_directory_header(directory, "b.npy", 3);
+
+  std::string tag = lazy ? "npz_read_lazy" : "npz_read_index";
+  // the first lookup in a lazy index scans the directory and the rest use
+  // the tables, so each rule is checked on a fresh index and on a used one.
+  // An exact match is preferred to one with the suffix, and a name which
+  // appears more than once refers to its last entry.
+  for (bool used : {false, true}) {
+    std::string suffix = used ? "" : "_first";
+    npy::file_index exact(std::string(directory), 4, lazy);
+    npy::file_index duplicate(std::string(directory), 4, lazy);
+    if (used) {
+      exact.contains("c");
+      duplicate.contains("c");
+    }
+
+    test::assert_equal(static_cast<std::uint64_t>(1),
+                       exact.find_npy("a")->offset, result,
+                       tag + "_exact" + suffix);
+    test::assert_equal(static_cast<std::uint64_t>(3),
+                       duplicate.find_npy("b")->offset, result,
+                       tag + "_duplicate" + suffix);
+  }
+
+  npy::file_index index(std::move(directory), 4, lazy);
+  test::assert_equal(static_cast<std::uint64_t>(3),
+                     index.find("b.npy")->offset, result,
+                     tag + "_duplicate_find");
+  test::assert_equal(true, index.find("b") == nullptr, result, tag + "_find");
+  test::assert_equal(true, index.find_npy("c") == nullptr, result,
+                     tag + "_find_missing");
+  test::assert_equal(std::vector<std::string>({"a", "a.npy", "b.npy"}),
+                     index.keys(), result, tag + "_duplicate_keys");
+}
+
+void read_past_end() {
+  // a header which claims more rows than its file holds, followed by another
+  // file which a slice of the missing rows would otherwise read
+  const std::string path = "temp_past_end.npz";
+  {
+    npy::npzfilewriter npz(path);
+    npz.write("a", test::test_tensor<std::uint8_t>({10, 10}));
+    npz.write("b", test::test_tensor<std::uint8_t>({100, 10}));
+  }
+
+  std::string bytes = test::read_file(path);
+  bytes.replace(bytes.find("(10, 10)"), 8, "(90, 10)");
+  {
+    std::ofstream output(path, std::ios::out | std::ios::binary);
+    output.write(bytes.data(), bytes.size());
+  }
+
+  try {
+    npy::npzfilereader stream(path);
+    stream.read_slice<std::uint8_t>("a", {{80, 81}});
+  } catch (...) {
+    std::filesystem::remove(path);
+    throw;
+  }
+
+  std::filesystem::remove(path);
+}
+
+void stored_compressed() {
+  npy::npzfilereader stream(test::asset_path("test_compressed.npz"));
+  stream.data_offset("color");
+}
 } // namespace
 
 int test_npz_read() {
@@ -67,6 +243,15 @@ int test_npz_read() {
   _test_large(result, "test_large.npz", false);
   _test_large(result, "test_large_compressed.npz", true);
   _test_memory(result, "test.npz");
+  _test_stored(result);
+  _test_index(result, false);
+  _test_index(result, true);
+  _test_index_precedence(result, false);
+  _test_index_precedence(result, true);
+  test::assert_throws<std::runtime_error>(stored_compressed, result,
+                                          "npz_read_stored_compressed");
+  test::assert_throws<std::out_of_range>(read_past_end, result,
+                                         "npz_read_stored_past_end");
 
   return result;
 }
\ No newline at end of file
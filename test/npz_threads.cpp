@@ -0,0 +1,94 @@
+#include <thread>
+
+#include "libnpy_tests.h"
+
+namespace {
+const std::string TEMP_NPZ = "temp_threads.npz";
+const int NUM_MEMBERS = 32;
+const int NUM_THREADS = 16;
+const int NUM_ROUNDS = 4;
+
+std::string member_name(int index) { return "tensor" + std::to_string(index); }
+
+npy::tensor<float> member_tensor(int index) {
+  auto tensor =
+      test::test_tensor<float>({static_cast<size_t>(index + 1), 8, 8});
+  for (auto &value : tensor) {
+    value += static_cast<float>(index);
+  }
+
+  return tensor;
+}
+
+bool read_all(npy::npzfilereader &reader, int thread, bool stored) {
+  bool success = true;
+  for (int round = 0; round < NUM_ROUNDS; ++round) {
+    for (int i = 0; i < NUM_MEMBERS; ++i) {
+      // each thread visits the members in a different order
+      int index = (i * 7 + thread * 5 + round) % NUM_MEMBERS;
+      std::string name = member_name(index);
+      auto expected = member_tensor(index);
+
+      auto actual = reader.read<npy::tensor<float>>(name);
+      success = success && actual.shape() == expected.shape() &&
+                actual.values() == expected.values();
+
+      npy::header_info info = reader.peek(name);
+      success = success && info.shape == expected.shape();
+
+      if (stored) {
+        size_t start = static_cast<size_t>(index);
+        auto slice = reader.read_slice<float>(name, {{start, start + 1}});
+        success = success && slice.size() == 64 &&
+                  slice(0, 3, 4) == expected(index, 3, 4);
+        success = success && reader.data_offset(name) > 0;
+      }
+    }
+  }
+
+  return success;
+}
+
+void _test_threads(int &result, npy::compression_method_t compression,
+                   bool lazy) {
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, compression);
+    for (int i = 0; i < NUM_MEMBERS; ++i) {
+      npz.write(member_name(i), member_tensor(i));
+    }
+  }
+
+  bool stored = compression == npy::compression_method_t::STORED;
+  std::string tag = stored ? "npz_threads_stored" : "npz_threads_deflated";
+  if (lazy) {
+    tag += "_lazy";
+  }
+
+  // a lazy reader is first used by all of the threads at once
+  npy::npzfilereader reader(TEMP_NPZ, lazy);
+  std::vector<int> success(NUM_THREADS, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < NUM_THREADS; ++t) {
+    threads.emplace_back(
+        [&, t]() { success[t] = read_all(reader, t, stored) ? 1 : 0; });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  test::assert_equal(std::vector<int>(NUM_THREADS, 1), success, result, tag);
+}
+} // namespace
+
+int test_npz_threads() {
+  int result = EXIT_SUCCESS;
+
+  _test_threads(result, npy::compression_method_t::STORED, false);
+  _test_threads(result, npy::compression_method_t::DEFLATED, false);
+  _test_threads(result, npy::compression_method_t::STORED, true);
+
+  std::filesystem::remove(TEMP_NPZ);
+
+  return result;
+}
@@ -9,6 +9,35 @@ const std::string TEMP_NPZ = "temp.npz";
 }
 
 namespace {
+/// Checks an archive written by a test against the asset. libdeflate
+/// compresses differently to the zlib which wrote the compressed asset, so
+/// those archives are compared by their contents instead.
+void assert_archive(const std::string &expected, const std::string &actual,
+                    [[maybe_unused]] npy::compression_method_t compression,
+                    int &result, const std::string &tag) {
+#ifdef LIBNPY_USE_LIBDEFLATE
+  if (compression == npy::compression_method_t::DEFLATED) {
+    npy::npzstringreader expected_npz(expected);
+    npy::npzstringreader actual_npz(actual);
+    test::assert_equal(expected_npz.keys(), actual_npz.keys(), result,
+                       tag + "_keys");
+    test::assert_equal(expected_npz.read<npy::tensor<std::uint8_t>>("color"),
+                       actual_npz.read<npy::tensor<std::uint8_t>>("color"),
+                       result, tag + "_color");
+    test::assert_equal(expected_npz.read<npy::tensor<float>>("depth"),
+                       actual_npz.read<npy::tensor<float>>("depth"), result,
+                       tag + "_depth");
+    test::assert_equal(
+        expected_npz.read<npy::tensor<std::wstring>>("unicode"),
+        actual_npz.read<npy::tensor<std::wstring>>("unicode"), result,
+        tag + "_unicode");
+    return;
+  }
+#endif
+
+  test::assert_equal(expected, actual, result, tag);
+}
+
 void _test(int &result, npy::compression_method_t compression_method) {
   std::string asset_name = "test.npz";
   std::string suffix = "";
@@ -27,7 +56,59 @@ void _test(int &result, npy::compression_method_t compression_method) {
   }
 
   std::string actual = test::read_file(TEMP_NPZ);
-  test::assert_equal(expected, actual, result, "npz_write" + suffix);
+  assert_archive(expected, actual, compression_method, result,
+                 "npz_write" + suffix);
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+
+void _test_append(int &result,
+                  npy::compression_method_t compression_method) {
+  std::string asset_name = "test.npz";
+  std::string suffix = "";
+  if (compression_method == npy::compression_method_t::DEFLATED) {
+    asset_name = "test_compressed.npz";
+    suffix = "_compressed";
+  }
+
+  std::string expected = test::read_asset(asset_name);
+
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, compression_method, npy::endian_t::LITTLE,
+                           0, 0, true);
+    npz.write("color", test::test_tensor<std::uint8_t>({5, 5, 3}));
+    npz.write("depth.npy", test::test_tensor<float>({5, 5}));
+  }
+
+  // appending produces the same archive as writing all of the files at once
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, compression_method, npy::endian_t::LITTLE,
+                           0, 0, true);
+    npz.write("unicode.npy", test::test_tensor<std::wstring>({5, 2, 5}));
+  }
+
+  std::string actual = test::read_file(TEMP_NPZ);
+  assert_archive(expected, actual, compression_method, result,
+                 "npz_write_append" + suffix);
+
+  // replacing a file leaves the old copy unreferenced
+  auto depth = test::test_tensor<float>({2, 3});
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, npy::compression_method_t::STORED,
+                           npy::endian_t::NATIVE, 0, 0, true);
+    npz.write("depth", depth);
+  }
+
+  npy::npzfilereader reader(TEMP_NPZ);
+  test::assert_equal(std::vector<std::string>({"color.npy", "depth.npy",
+                                               "unicode.npy"}),
+                     reader.keys(), result, "npz_write_replace_keys" + suffix);
+  test::assert_equal(depth, reader.read<npy::tensor<float>>("depth"), result,
+                     "npz_write_replace" + suffix);
+  test::assert_equal(test::test_tensor<std::uint8_t>({5, 5, 3}),
+                     reader.read<npy::tensor<std::uint8_t>>("color"), result,
+                     "npz_write_replace_color" + suffix);
+  reader.close();
 
   std::filesystem::remove(TEMP_NPZ);
 }
@@ -48,6 +129,145 @@ void _test_memory(int &result) {
 
   test::assert_equal(expected, actual, result, "npz_write_memory");
 }
+
+void _test_parallel(int &result,
+                    npy::compression_method_t compression_method) {
+  std::string asset_name = "test.npz";
+  std::string suffix = "";
+  if (compression_method == npy::compression_method_t::DEFLATED) {
+    asset_name = "test_compressed.npz";
+    suffix = "_compressed";
+  }
+
+  std::string expected = test::read_asset(asset_name);
+
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, compression_method, npy::endian_t::LITTLE,
+                           4);
+    npz.write("color", test::test_tensor<std::uint8_t>({5, 5, 3}));
+    npz.write("depth.npy", test::test_tensor<float>({5, 5}));
+    npz.write("unicode.npy", test::test_tensor<std::wstring>({5, 2, 5}));
+  }
+
+  std::string actual = test::read_file(TEMP_NPZ);
+  assert_archive(expected, actual, compression_method, result,
+                 "npz_write_parallel" + suffix);
+
+  std::filesystem::remove(TEMP_NPZ);
+
+  // more files than the queue holds at once, of varying sizes
+  npy::npzstringwriter serial(compression_method);
+  npy::npzstringwriter parallel(compression_method, npy::endian_t::NATIVE, 3);
+  for (size_t i = 0; i < 20; ++i) {
+    std::string name = "tensor" + std::to_string(i);
+    auto tensor = test::test_tensor<std::int32_t>({i + 1, 17, 31});
+    serial.write(name, tensor);
+    parallel.write(name, tensor);
+  }
+
+  serial.close();
+  parallel.close();
+  test::assert_equal(serial.str(), parallel.str(), result,
+                     "npz_write_parallel_many" + suffix);
+}
+
+void _test_large(int &result, npy::compression_method_t compression_method,
+                 npy::endian_t endianness, const std::string &tag,
+                 size_t num_threads = 0, size_t block_size = 0) {
+  // large enough that the data spans many windows of the member stream
+  auto expected = test::test_tensor<float>({64, 128, 129});
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, compression_method, endianness,
+                           num_threads, block_size);
+    npz.write("large", expected);
+    npz.write("color", test::test_tensor<std::uint8_t>({5, 5, 3}));
+  }
+
+  npy::npzfilereader npz(TEMP_NPZ);
+  auto actual = npz.read<npy::tensor<float>>("large");
+  test::assert_equal(expected, actual, result, "npz_write_large" + tag);
+
+  auto color = npz.read<npy::tensor<std::uint8_t>>("color");
+  test::assert_equal(test::test_tensor<std::uint8_t>({5, 5, 3}), color,
+                     result, "npz_write_large" + tag + "_color");
+  npz.close();
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+
+void _test_streamed_blocks(int &result) {
+  // the blocks of a single large file are written as they are compressed,
+  // rather than all being held until the writer is closed
+  auto expected = test::test_tensor<float>({64, 128, 129});
+  {
+    npy::npzfilewriter npz(TEMP_NPZ, npy::compression_method_t::DEFLATED,
+                           npy::endian_t::NATIVE, 3, 100000);
+    npz.write("large", expected);
+    test::assert_equal(true, std::filesystem::file_size(TEMP_NPZ) > 100000,
+                       result, "npz_write_streamed_blocks_size");
+  }
+
+  npy::npzfilereader npz(TEMP_NPZ);
+  test::assert_equal(expected, npz.read<npy::tensor<float>>("large"), result,
+                     "npz_write_streamed_blocks");
+  npz.close();
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+
+void _test_level(int &result, npy::compression_method_t compression_method,
+                 int fast_level, int small_level, const std::string &tag,
+                 size_t num_threads = 0, size_t block_size = 0) {
+  auto expected = test::test_tensor<std::int32_t>({32, 64, 65});
+  npy::npzstringwriter fast(compression_method, npy::endian_t::NATIVE,
+                            num_threads, block_size);
+  npy::npzstringwriter small(compression_method, npy::endian_t::NATIVE,
+                             num_threads, block_size);
+  fast.set_compression_level(fast_level);
+  small.set_compression_level(small_level);
+  fast.write("tensor", expected);
+  small.write("tensor", expected);
+  fast.close();
+  small.close();
+
+  npy::npzstringreader fast_reader(fast.str());
+  npy::npzstringreader small_reader(small.str());
+  test::assert_equal(expected,
+                     fast_reader.read<npy::tensor<std::int32_t>>("tensor"),
+                     result, "npz_write" + tag + "_level_fast");
+  test::assert_equal(expected,
+                     small_reader.read<npy::tensor<std::int32_t>>("tensor"),
+                     result, "npz_write" + tag + "_level_small");
+  test::assert_equal(true, small.str().size() < fast.str().size(), result,
+                     "npz_write" + tag + "_level_size");
+}
+
+#ifdef LIBNPY_USE_LIBDEFLATE
+void _test_block_level_cap(int &result) {
+  // blocks are compressed by miniz, whose highest level is 10
+  auto expected = test::test_tensor<std::int32_t>({32, 64, 65});
+  npy::npzstringwriter highest(npy::compression_method_t::DEFLATED,
+                               npy::endian_t::NATIVE, 3, 100000);
+  npy::npzstringwriter capped(npy::compression_method_t::DEFLATED,
+                              npy::endian_t::NATIVE, 3, 100000);
+  highest.set_compression_level(12);
+  capped.set_compression_level(10);
+  highest.write("tensor", expected);
+  capped.write("tensor", expected);
+  highest.close();
+  capped.close();
+
+  test::assert_equal(capped.str(), highest.str(), result,
+                     "npz_write_compressed_blocks_level_cap");
+}
+#endif
+
+#ifndef LIBNPY_USE_ZSTD
+void write_zstd() {
+  npy::npzstringwriter npz(npy::compression_method_t::ZSTD);
+  npz.write("color", test::test_tensor<std::uint8_t>({5, 5, 3}));
+}
+#endif
 } // namespace
 
 int test_npz_write() {
@@ -55,7 +275,47 @@ int test_npz_write() {
 
   _test(result, npy::compression_method_t::STORED);
   _test(result, npy::compression_method_t::DEFLATED);
+  _test_append(result, npy::compression_method_t::STORED);
+  _test_append(result, npy::compression_method_t::DEFLATED);
   _test_memory(result);
+  _test_parallel(result, npy::compression_method_t::STORED);
+  _test_parallel(result, npy::compression_method_t::DEFLATED);
+  _test_large(result, npy::compression_method_t::STORED,
+              npy::endian_t::NATIVE, "");
+  _test_large(result, npy::compression_method_t::DEFLATED,
+              npy::endian_t::NATIVE, "_compressed");
+  _test_large(result, npy::compression_method_t::DEFLATED,
+              npy::endian_t::BIG, "_compressed_big");
+  _test_large(result, npy::compression_method_t::STORED,
+              npy::endian_t::NATIVE, "_blocks", 3, 100000);
+  _test_large(result, npy::compression_method_t::DEFLATED,
+              npy::endian_t::NATIVE, "_compressed_blocks", 3, 100000);
+  _test_streamed_blocks(result);
+#ifdef LIBNPY_USE_LIBDEFLATE
+  _test_level(result, npy::compression_method_t::DEFLATED, 1, 12,
+              "_compressed");
+#else
+  _test_level(result, npy::compression_method_t::DEFLATED, 1, 10,
+              "_compressed");
+#endif
+  _test_level(result, npy::compression_method_t::DEFLATED, 1, 10,
+              "_compressed_blocks", 3, 100000);
+#ifdef LIBNPY_USE_LIBDEFLATE
+  _test_block_level_cap(result);
+#endif
+
+#ifdef LIBNPY_USE_ZSTD
+  _test_large(result, npy::compression_method_t::ZSTD, npy::endian_t::NATIVE,
+              "_zstd");
+  _test_large(result, npy::compression_method_t::ZSTD, npy::endian_t::NATIVE,
+              "_zstd_parallel", 3);
+  _test_large(result, npy::compression_method_t::ZSTD, npy::endian_t::NATIVE,
+              "_zstd_blocks", 3, 100000);
+  _test_level(result, npy::compression_method_t::ZSTD, 1, 19, "_zstd");
+#else
+  test::assert_throws<std::invalid_argument>(write_zstd, result,
+                                             "npz_write_zstd_unsupported");
+#endif
 
   return result;
 }
\ No newline at end of file
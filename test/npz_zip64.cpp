@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "libnpy_tests.h"
+
+namespace {
+const std::string TEMP_NPZ = "temp_zip64.npz";
+
+void _test_many_entries(int &result) {
+  const size_t num_entries = 70000;
+  npy::tensor<std::uint8_t> tensor({1});
+  npy::npzstringwriter writer;
+  for (size_t i = 0; i < num_entries; ++i) {
+    *tensor.data() = static_cast<std::uint8_t>(i);
+    writer.write(std::to_string(i), tensor);
+  }
+
+  writer.close();
+
+  npy::npzstringreader reader(writer.str());
+  test::assert_equal(num_entries, reader.keys().size(), result,
+                     "npz_zip64_many_entries_count");
+  for (size_t i : {size_t(0), size_t(65534), size_t(65535), num_entries - 1}) {
+    auto actual = reader.read<npy::tensor<std::uint8_t>>(std::to_string(i));
+    test::assert_equal(static_cast<std::uint8_t>(i), *actual.data(), result,
+                       "npz_zip64_many_entries_" + std::to_string(i));
+  }
+}
+
+template <typename T> void put(std::string &bytes, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    bytes.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+  }
+}
+
+/// An empty archive whose ZIP64 directory records start at offset, preceded
+/// by a hole, so that a sparse file can put it past 4 GB.
+std::string empty_zip64_archive(std::uint64_t offset) {
+  std::string bytes;
+  put<std::uint32_t>(bytes, 0x06064B50); // ZIP64 end of central directory
+  put<std::uint64_t>(bytes, 44);         // size of the rest of the record
+  put<std::uint16_t>(bytes, 45);         // version made by
+  put<std::uint16_t>(bytes, 45);         // version needed
+  put<std::uint32_t>(bytes, 0);          // this disk
+  put<std::uint32_t>(bytes, 0);          // disk with the directory
+  put<std::uint64_t>(bytes, 0);          // entries on this disk
+  put<std::uint64_t>(bytes, 0);          // entries
+  put<std::uint64_t>(bytes, 0);          // size of the directory
+  put<std::uint64_t>(bytes, offset);     // offset of the directory
+  put<std::uint32_t>(bytes, 0x07064B50); // ZIP64 locator
+  put<std::uint32_t>(bytes, 0);          // disk with the ZIP64 record
+  put<std::uint64_t>(bytes, offset);     // offset of the ZIP64 record
+  put<std::uint32_t>(bytes, 1);          // number of disks
+  put<std::uint32_t>(bytes, 0x06054B50); // end of central directory
+  put<std::uint16_t>(bytes, 0);          // this disk
+  put<std::uint16_t>(bytes, 0);          // disk with the directory
+  put<std::uint16_t>(bytes, 0xFFFF);     // entries on this disk
+  put<std::uint16_t>(bytes, 0xFFFF);     // entries
+  put<std::uint32_t>(bytes, 0xFFFFFFFF); // size of the directory
+  put<std::uint32_t>(bytes, 0xFFFFFFFF); // offset of the directory
+  put<std::uint16_t>(bytes, 0);          // comment length
+  return bytes;
+}
+
+void _test_sparse_archive(int &result) {
+  // members appended after a 5 GB hole have local headers, and a directory,
+  // past 4 GB, without the data ever being written
+  const std::uint64_t hole = 5ull * 1024 * 1024 * 1024;
+  {
+    std::ofstream output(TEMP_NPZ, std::ios::binary);
+  }
+
+  std::filesystem::resize_file(TEMP_NPZ, hole);
+  {
+    std::ofstream output(TEMP_NPZ,
+                         std::ios::binary | std::ios::in | std::ios::out);
+    output.seekp(0, std::ios::end);
+    std::string end = empty_zip64_archive(hole);
+    output.write(end.data(), end.size());
+  }
+
+  auto color = test::test_tensor<std::uint8_t>({5, 5, 3});
+  auto depth = test::test_tensor<float>({5, 5});
+  {
+    npy::npzfilewriter writer(TEMP_NPZ, npy::compression_method_t::STORED,
+                              npy::endian_t::NATIVE, 0, 0, true);
+    writer.write("color", color);
+    writer.write("depth", depth, npy::compression_method_t::DEFLATED);
+  }
+
+  {
+    npy::npzfilereader reader(TEMP_NPZ);
+    test::assert_equal(std::vector<std::string>({"color.npy", "depth.npy"}),
+                       reader.keys(), result, "npz_zip64_sparse_keys");
+    for (auto &info : reader.manifest()) {
+      test::assert_equal(true, info.entry.offset >= hole, result,
+                         "npz_zip64_sparse_offset_" + info.entry.filename);
+    }
+
+    test::assert_equal(color, reader.read<npy::tensor<std::uint8_t>>("color"),
+                       result, "npz_zip64_sparse_color");
+    test::assert_equal(depth, reader.read<npy::tensor<float>>("depth"),
+                       result, "npz_zip64_sparse_depth");
+  }
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+} // namespace
+
+int test_npz_zip64() {
+  int result = EXIT_SUCCESS;
+
+  _test_many_entries(result);
+  _test_sparse_archive(result);
+
+  return result;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "libnpy_tests.h"
+
+namespace {
+const std::string TEMP_NPZ = "temp_zip64_large.npz";
+const size_t CHUNK_SIZE = 1024 * 1024;
+
+/// A tensor of zeros which is streamed rather than stored, so that files too
+/// large to hold in memory can be written and read back.
+class zeros_tensor {
+public:
+  explicit zeros_tensor(std::uint64_t size) : m_size(size), m_zeros(true) {}
+
+  static zeros_tensor load(std::basic_istream<char> &input,
+                           const npy::header_info &info) {
+    zeros_tensor result(info.shape[0]);
+    std::vector<char> buffer(CHUNK_SIZE);
+    std::uint64_t remaining = result.m_size;
+    while (remaining > 0) {
+      size_t size = static_cast<size_t>(
+          std::min<std::uint64_t>(remaining, buffer.size()));
+      if (!input.read(buffer.data(), size)) {
+        throw std::runtime_error("Unexpected end of data");
+      }
+
+      if (std::any_of(buffer.begin(), buffer.begin() + size,
+                      [](char c) { return c != 0; })) {
+        result.m_zeros = false;
+      }
+
+      remaining -= size;
+    }
+
+    return result;
+  }
+
+  void save(std::basic_ostream<char> &output, npy::endian_t) const {
+    std::vector<char> buffer(CHUNK_SIZE, 0);
+    std::uint64_t remaining = m_size;
+    while (remaining > 0) {
+      size_t size = static_cast<size_t>(
+          std::min<std::uint64_t>(remaining, buffer.size()));
+      output.write(buffer.data(), size);
+      remaining -= size;
+    }
+  }
+
+  std::uint64_t size() const { return m_size; }
+
+  bool zeros() const { return m_zeros; }
+
+  size_t ndim() const { return 1; }
+
+  size_t shape(size_t) const { return static_cast<size_t>(m_size); }
+
+  std::string dtype(npy::endian_t endianness) const {
+    return npy::to_dtype(npy::data_type_t::UINT8, endianness);
+  }
+
+  bool fortran_order() const { return false; }
+
+private:
+  std::uint64_t m_size;
+  bool m_zeros;
+};
+
+void _test_large_archive(int &result) {
+  // a file larger than 4 GB, so that the sizes of the file and the offsets of
+  // both the following file and the central directory all need ZIP64 fields
+  const std::uint64_t size = 6ull * 1024 * 1024 * 1024;
+  auto before = test::test_tensor<float>({3, 4});
+  auto after = test::test_tensor<std::int32_t>({5, 6});
+  {
+    npy::npzfilewriter writer(TEMP_NPZ);
+    writer.write("before", before);
+    writer.write("zeros", zeros_tensor(size));
+    writer.write("after", after);
+  }
+
+  {
+    npy::npzfilereader reader(TEMP_NPZ);
+    test::assert_equal(size_t(3), reader.keys().size(), result,
+                       "npz_zip64_large_count");
+    test::assert_equal(before, reader.read<npy::tensor<float>>("before"),
+                       result, "npz_zip64_large_before");
+    test::assert_equal(after, reader.read<npy::tensor<std::int32_t>>("after"),
+                       result, "npz_zip64_large_after");
+
+    zeros_tensor zeros = reader.read<zeros_tensor>("zeros");
+    test::assert_equal(size, zeros.size(), result, "npz_zip64_large_size");
+    test::assert_equal(true, zeros.zeros(), result, "npz_zip64_large_zeros");
+  }
+
+  std::filesystem::remove(TEMP_NPZ);
+}
+} // namespace
+
+int test_npz_zip64_large() {
+  int result = EXIT_SUCCESS;
+
+  _test_large_archive(result);
+
+  return result;
+}
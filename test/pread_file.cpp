@@ -0,0 +1,152 @@
+#include <filesystem>
+#include <thread>
+
+#include "libnpy_tests.h"
+
+#ifdef LIBNPY_USE_IO_URING
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "uring.h"
+#endif
+
+namespace {
+const std::string TEMP_FILE = "temp_pread.bin";
+const std::string TEMP_NPY = "temp_pread.npy";
+
+// large enough to be split into many chunks when io_uring is enabled
+const size_t FILE_SIZE = 5 * 1024 * 1024 + 123;
+
+void _test_read(int &result, const std::shared_ptr<const npy::pread_file> &file,
+                const std::string &expected, std::uint64_t offset,
+                size_t size) {
+  std::string tag = "pread_file_read_" + std::to_string(offset) + "_" +
+                    std::to_string(size);
+  std::string actual(size, '\0');
+  size_t count = file->read(offset, actual.data(), size);
+  std::uint64_t available =
+      expected.size() - std::min<std::uint64_t>(offset, expected.size());
+  size_t expected_count =
+      static_cast<size_t>(std::min<std::uint64_t>(size, available));
+  test::assert_equal(expected_count, count, result, tag + "_count");
+  actual.resize(count);
+  test::assert_equal(expected.substr(offset, count), actual, result, tag);
+}
+
+void _test_stream(int &result,
+                  const std::shared_ptr<const npy::pread_file> &file,
+                  const std::string &expected) {
+  npy::ipreadstream input(file);
+  std::string actual(1000, '\0');
+  input.seekg(3 * 1024 * 1024 + 7);
+  input.read(actual.data(), actual.size());
+  test::assert_equal(expected.substr(3 * 1024 * 1024 + 7, 1000), actual, result,
+                     "pread_file_stream_seek");
+
+  input.seekg(-500, std::ios::cur);
+  input.read(actual.data(), actual.size());
+  test::assert_equal(expected.substr(3 * 1024 * 1024 + 507, 1000), actual,
+                     result, "pread_file_stream_back");
+
+  // a large read bypasses the window, which must not be reused by a seek
+  // back into the range it appeared to cover
+  std::string large(256 * 1024, '\0');
+  input.seekg(0);
+  input.read(actual.data(), 10);
+  input.read(large.data(), large.size());
+  test::assert_equal(expected.substr(10, large.size()), large, result,
+                     "pread_file_stream_bypass");
+  input.seekg(200 * 1024);
+  input.read(actual.data(), actual.size());
+  test::assert_equal(expected.substr(200 * 1024, 1000), actual, result,
+                     "pread_file_stream_bypass_back");
+
+  input.seekg(-10, std::ios::end);
+  input.read(actual.data(), actual.size());
+  test::assert_equal(static_cast<std::streamsize>(10), input.gcount(), result,
+                     "pread_file_stream_end");
+  test::assert_equal(true, input.eof(), result, "pread_file_stream_eof");
+}
+
+#ifdef LIBNPY_USE_IO_URING
+void _test_uring_failure(int &result, const std::string &expected) {
+  // on a thread of its own, as the failure can leave it without a ring
+  std::thread worker([&]() {
+    npy::uring_reader *reader = npy::uring_reader::local();
+    if (reader == nullptr) {
+      // io_uring is not available here
+      return;
+    }
+
+    int fd = ::open(TEMP_FILE.c_str(), O_RDONLY);
+    std::string actual(FILE_SIZE, '\0');
+
+    // the first call fails with reads in flight, which are waited for
+    npy::uring_reader::fail_enter(0, 1);
+    size_t count = reader->read(fd, 0, actual.data(), actual.size());
+    test::assert_equal(FILE_SIZE, count, result,
+                       "pread_file_uring_failure_count");
+    test::assert_equal(expected, actual, result, "pread_file_uring_failure");
+    test::assert_equal(true, npy::uring_reader::local() != nullptr, result,
+                       "pread_file_uring_failure_valid");
+
+    // waiting fails as well, so the ring is abandoned
+    actual.assign(FILE_SIZE, '\0');
+    npy::uring_reader::fail_enter(0, 2);
+    count = reader->read(fd, 0, actual.data(), actual.size());
+    test::assert_equal(FILE_SIZE, count, result,
+                       "pread_file_uring_failure_wait_count");
+    test::assert_equal(expected, actual, result,
+                       "pread_file_uring_failure_wait");
+    test::assert_equal(true, npy::uring_reader::local() == nullptr, result,
+                       "pread_file_uring_failure_invalid");
+    ::close(fd);
+  });
+
+  worker.join();
+}
+#endif
+
+void pread_missing() { npy::pread_file file("does_not_exist.bin"); }
+} // namespace
+
+int test_pread_file() {
+  int result = EXIT_SUCCESS;
+
+  std::string expected(FILE_SIZE, '\0');
+  for (size_t i = 0; i < FILE_SIZE; ++i) {
+    expected[i] = static_cast<char>((i * 2654435761u) >> 13);
+  }
+
+  {
+    std::ofstream output(TEMP_FILE, std::ios::out | std::ios::binary);
+    output.write(expected.data(), expected.size());
+  }
+
+  auto file = std::make_shared<const npy::pread_file>(TEMP_FILE);
+  test::assert_equal(static_cast<std::uint64_t>(FILE_SIZE), file->size(),
+                     result, "pread_file_size");
+  _test_read(result, file, expected, 0, FILE_SIZE);
+  _test_read(result, file, expected, 0, 100);
+  _test_read(result, file, expected, 12345, 3 * 1024 * 1024 + 1);
+  _test_read(result, file, expected, 1024, FILE_SIZE);
+  _test_read(result, file, expected, FILE_SIZE - 10, 100);
+  _test_read(result, file, expected, FILE_SIZE, 100);
+  _test_stream(result, file, expected);
+#ifdef LIBNPY_USE_IO_URING
+  _test_uring_failure(result, expected);
+#endif
+  test::assert_throws<std::invalid_argument>(pread_missing, result,
+                                             "pread_file_missing");
+
+  auto tensor = test::test_tensor<float>({1024, 1024, 3});
+  npy::save(TEMP_NPY, tensor);
+  test::assert_equal(tensor, npy::load<npy::tensor<float>>(TEMP_NPY), result,
+                     "pread_file_load");
+
+  file.reset();
+  std::filesystem::remove(TEMP_FILE);
+  std::filesystem::remove(TEMP_NPY);
+
+  return result;
+}